@@ -1,71 +1,986 @@
 ﻿#include <algorithm>
 #include <atomic>
+#include <bitset>
+#include <charconv>
 #include <cstdint>
+#include <cstring>
 #include <execution>
+#include <fstream>
 #include <functional>
 #include <iterator>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <numeric>
 #include <random>
+#include <stdexcept>
+#include <string>
 #include <string_view>
-
+#include <thread>
+#include <type_traits>
+
+#include "char_scan.h"
+#include "concurrent_append_buffer.h"
+#include "counter_rng.h"
+#include "mapped_file.h"
+#include "numa.h"
 #include "profile.h"
+#include "thread_pool.h"
 
 using namespace std;
 
 
-class Graph {
+// Невладеющий view на непрерывный кусок массива (аналог std::span из C++20)
+template <typename T>
+class Span {
 public:
-    Graph(int vertex_count)
-        : adjacency_lists_(vertex_count),
-          vertex_weights_(vertex_count) {}
+    Span() = default;
+    Span(T* begin, T* end) : begin_(begin), end_(end) {}
+
+    T* begin() const {
+        return begin_;
+    }
 
-    void AddEdge(int vertex_from, int vertex_to) {
-        adjacency_lists_[vertex_from].push_back(vertex_to);
+    T* end() const {
+        return end_;
     }
 
-    int GetVertexCount() const {
-        return adjacency_lists_.size();
+    size_t size() const {
+        return end_ - begin_;
     }
 
-    const vector<int>& GetAdjacentVertices(int vertex) const {
-        return adjacency_lists_[vertex];
+    bool empty() const {
+        return begin_ == end_;
     }
 
-    int operator[](int vertex) const {
+    T& operator[](size_t index) const {
+        return begin_[index];
+    }
+
+private:
+    T* begin_ = nullptr;
+    T* end_ = nullptr;
+};
+
+// Номера вершин – VertexId, смещения в массивах рёбер – EdgeOffset.
+// 32-битных хватает, пока вершин и рёбер меньше 2^31; дальше нужны 64-битные
+template <typename VertexId>
+struct BasicEdge {
+    VertexId from;
+    VertexId to;
+};
+
+using Edge = BasicEdge<int>;
+
+// Заголовок снимка графа на диске. Сразу за ним подряд лежат массивы в том же виде,
+// что и в памяти: offsets[n + 1], adjacent_vertices[m], parent_offsets[n + 1],
+// parent_vertices[m] (смещения по offset_size байт, номера вершин по vertex_id_size)
+// и vertex_weights[n] типа int; каждый массив дополнен до границы 8 байт
+struct GraphFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t vertex_count;
+    uint64_t edge_count;
+    uint32_t vertex_id_size;
+    uint32_t offset_size;
+};
+
+constexpr char kGraphFileMagic[8] = {'B', 'F', 'S', 'G', 'R', 'A', 'P', 'H'};
+constexpr uint32_t kGraphFileVersion = 2;
+
+void CheckGraphFileHeader(const GraphFileHeader& header, const string& path) {
+    if (!equal(begin(kGraphFileMagic), end(kGraphFileMagic), header.magic)
+        || header.version != kGraphFileVersion
+        || header.header_size != sizeof(header)) {
+        throw runtime_error(path + " is not a graph snapshot");
+    }
+}
+
+// заголовок снимка без отображения всего файла – чтобы выбрать типы до Load
+GraphFileHeader ReadGraphFileHeader(const string& path) {
+    GraphFileHeader header = {};
+    ifstream input(path, ios::binary);
+    if (!input.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        throw runtime_error(path + " is not a graph snapshot");
+    }
+    CheckGraphFileHeader(header, path);
+    return header;
+}
+
+// Граф в формате CSR (compressed sparse row): дети вершины v лежат
+// в adjacent_vertices_[offsets_[v], offsets_[v + 1]).
+// Обратный индекс (родители вершины) хранится так же, в parent_offsets_ и parent_vertices_.
+// Все массивы – куски одного буфера, который либо принадлежит графу,
+// либо является отображённым в память снимком (см. Save и Load).
+template <typename VertexIdType, typename EdgeOffsetType>
+class BasicGraph {
+public:
+    using VertexId = VertexIdType;
+    using EdgeOffset = EdgeOffsetType;
+
+    // рёбра могут быть с номерами любого целого типа, лишь бы они помещались в VertexId
+    template <typename SourceVertexId>
+    BasicGraph(vector<int> vertex_weights, const vector<BasicEdge<SourceVertexId>>& edges)
+        : storage_((GetDataSize(vertex_weights.size(), edges.size()) + sizeof(uint64_t) - 1) / sizeof(uint64_t)) {
+        using SourceEdge = BasicEdge<SourceVertexId>;
+        SetLayout(reinterpret_cast<char*>(storage_.data()), vertex_weights.size(), edges.size());
+        copy(execution::par, vertex_weights.begin(), vertex_weights.end(), vertex_weights_.begin());
+        BuildCsr(edges, &SourceEdge::from, &SourceEdge::to, offsets_, adjacent_vertices_);
+        BuildCsr(edges, &SourceEdge::to, &SourceEdge::from, parent_offsets_, parent_vertices_);
+    }
+
+    BasicGraph(BasicGraph&&) = default;
+    BasicGraph& operator=(BasicGraph&&) = default;
+
+    // сохраняет снимок графа, который потом можно быстро открыть через Load
+    void Save(const string& path) const {
+        GraphFileHeader header = {};
+        copy(begin(kGraphFileMagic), end(kGraphFileMagic), header.magic);
+        header.version = kGraphFileVersion;
+        header.header_size = sizeof(GraphFileHeader);
+        header.vertex_count = GetVertexCount();
+        header.edge_count = GetEdgeCount();
+        header.vertex_id_size = sizeof(VertexId);
+        header.offset_size = sizeof(EdgeOffset);
+
+        ofstream output(path, ios::binary);
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        output.write(data_.begin(), data_.size());
+        if (!output) {
+            throw runtime_error("cannot write graph snapshot " + path);
+        }
+    }
+
+    // отображает снимок в память без копирования и один раз проверяет его массивы (CheckLayout);
+    // изменения весов в файл не попадают
+    static BasicGraph Load(const string& path) {
+        auto file = make_unique<MappedFile>(path);
+        GraphFileHeader header = {};
+        if (file->size() < sizeof(header)) {
+            throw runtime_error(path + " is not a graph snapshot");
+        }
+        memcpy(&header, file->data(), sizeof(header));
+        CheckGraphFileHeader(header, path);
+        if (header.vertex_id_size != sizeof(VertexId) || header.offset_size != sizeof(EdgeOffset)) {
+            throw runtime_error(path + " has other vertex id or offset types");
+        }
+        if (header.vertex_count >= static_cast<uint64_t>(numeric_limits<VertexId>::max())
+            || header.edge_count >= static_cast<uint64_t>(numeric_limits<EdgeOffset>::max())
+            || file->size() != sizeof(header) + GetDataSize(header.vertex_count, header.edge_count)) {
+            throw runtime_error(path + " has wrong size");
+        }
+
+        BasicGraph graph;
+        graph.SetLayout(file->data() + sizeof(header), header.vertex_count, header.edge_count);
+        graph.file_ = move(file);
+        graph.CheckLayout(path);
+        return graph;
+    }
+
+    VertexId GetVertexCount() const {
+        return vertex_weights_.size();
+    }
+
+    EdgeOffset GetEdgeCount() const {
+        return adjacent_vertices_.size();
+    }
+
+    Span<const VertexId> GetAdjacentVertices(VertexId vertex) const {
+        return {
+            adjacent_vertices_.begin() + offsets_[vertex],
+            adjacent_vertices_.begin() + offsets_[vertex + 1]
+        };
+    }
+
+    Span<const VertexId> GetParentVertices(VertexId vertex) const {
+        return {
+            parent_vertices_.begin() + parent_offsets_[vertex],
+            parent_vertices_.begin() + parent_offsets_[vertex + 1]
+        };
+    }
+
+    int operator[](VertexId vertex) const {
         return vertex_weights_[vertex];
     }
 
-    int& operator[](int vertex) {
+    int& operator[](VertexId vertex) {
+        return vertex_weights_[vertex];
+    }
+
+    // все массивы графа одним куском – например, чтобы узнать, на каких NUMA-узлах они лежат
+    Span<const char> GetStorage() const {
+        return {data_.begin(), data_.end()};
+    }
+
+private:
+    BasicGraph() = default;
+
+    // размер массива в байтах с выравниванием до 8, чтобы следующий был выровнен
+    static size_t GetArraySize(size_t count, size_t element_size) {
+        return (count * element_size + 7) / 8 * 8;
+    }
+
+    static size_t GetDataSize(size_t vertex_count, size_t edge_count) {
+        return 2 * GetArraySize(vertex_count + 1, sizeof(EdgeOffset))
+            + 2 * GetArraySize(edge_count, sizeof(VertexId))
+            + GetArraySize(vertex_count, sizeof(int));
+    }
+
+    // очередной массив из size элементов типа T начиная с end; end сдвигается за него
+    template <typename T>
+    static Span<T> Take(char*& end, size_t size) {
+        T* const begin = reinterpret_cast<T*>(end);
+        end += GetArraySize(size, sizeof(T));
+        return {begin, begin + size};
+    }
+
+    // Снимку с диска не доверяем: смещения должны начинаться с нуля, не убывать
+    // и кончаться на числе рёбер, а номера вершин – лежать в [0, n). Иначе обход
+    // битого или обрезанного снимка читал бы мимо массивов
+    void CheckLayout(const string& path) const {
+        const VertexId vertex_count = GetVertexCount();
+        const EdgeOffset edge_count = GetEdgeCount();
+        auto are_offsets_valid = [&](Span<EdgeOffset> offsets) {
+            return offsets[0] == 0 && offsets[vertex_count] == edge_count
+                && is_sorted(execution::par, offsets.begin(), offsets.end());
+        };
+        auto are_vertices_valid = [&](Span<VertexId> vertices) {
+            return all_of(execution::par, vertices.begin(), vertices.end(), [vertex_count](VertexId vertex) {
+                return vertex >= 0 && vertex < vertex_count;
+            });
+        };
+        if (!are_offsets_valid(offsets_) || !are_offsets_valid(parent_offsets_)) {
+            throw runtime_error(path + " has corrupt edge offsets");
+        }
+        if (!are_vertices_valid(adjacent_vertices_) || !are_vertices_valid(parent_vertices_)) {
+            throw runtime_error(path + " has vertex ids out of range");
+        }
+    }
+
+    void SetLayout(char* data, size_t vertex_count, size_t edge_count) {
+        char* end = data;
+        offsets_ = Take<EdgeOffset>(end, vertex_count + 1);
+        adjacent_vertices_ = Take<VertexId>(end, edge_count);
+        parent_offsets_ = Take<EdgeOffset>(end, vertex_count + 1);
+        parent_vertices_ = Take<VertexId>(end, edge_count);
+        vertex_weights_ = Take<int>(end, vertex_count);
+        data_ = Span<char>(data, end);
+    }
+
+    // параллельная сортировка подсчётом по полю key; соседи каждой вершины
+    // упорядочены по возрастанию, так что результат не зависит от числа потоков
+    template <typename SourceEdge, typename SourceVertexId>
+    void BuildCsr(const vector<SourceEdge>& edges, SourceVertexId SourceEdge::* key,
+                  SourceVertexId SourceEdge::* value, Span<EdgeOffset> offsets, Span<VertexId> vertices) const {
+        vector<atomic<EdgeOffset>> places(vertex_weights_.size());
+        for_each(execution::par, places.begin(), places.end(), [](atomic<EdgeOffset>& place) {
+            place.store(0, memory_order_relaxed);
+        });
+        for_each(execution::par, edges.begin(), edges.end(), [&places, key](const SourceEdge& edge) {
+            places[edge.*key].fetch_add(1, memory_order_relaxed);
+        });
+
+        offsets[0] = 0;
+        transform_inclusive_scan(
+            execution::par,
+            places.begin(), places.end(),
+            offsets.begin() + 1,
+            plus<>{},
+            [](const atomic<EdgeOffset>& count) -> EdgeOffset {
+                return count.load(memory_order_relaxed);
+            }
+        );
+        for_each(execution::par, places.begin(), places.end(), [&places, offsets](atomic<EdgeOffset>& place) {
+            place.store(offsets[&place - places.data()], memory_order_relaxed);
+        });
+
+        for_each(execution::par, edges.begin(), edges.end(), [&](const SourceEdge& edge) {
+            vertices[places[edge.*key].fetch_add(1, memory_order_relaxed)] = static_cast<VertexId>(edge.*value);
+        });
+        for_each(execution::par, places.begin(), places.end(), [&](const atomic<EdgeOffset>& place) {
+            const size_t vertex = &place - places.data();
+            sort(vertices.begin() + offsets[vertex], vertices.begin() + offsets[vertex + 1]);
+        });
+    }
+
+    NumaVector<uint64_t> storage_;
+    unique_ptr<MappedFile> file_;
+
+    Span<char> data_;
+    Span<EdgeOffset> offsets_;
+    Span<VertexId> adjacent_vertices_;
+    Span<EdgeOffset> parent_offsets_;
+    Span<VertexId> parent_vertices_;
+    Span<int> vertex_weights_;
+};
+
+using Graph = BasicGraph<int, int>;
+
+// Наименьшие типы номеров и смещений, в которые помещается граф: вызывает
+// on_types(GraphTypes<VertexId, EdgeOffset>{}) с выбранными типами
+template <typename VertexId, typename EdgeOffset>
+struct GraphTypes {
+    using Graph = BasicGraph<VertexId, EdgeOffset>;
+};
+
+template <typename OnTypes>
+void DispatchGraphTypes(uint64_t vertex_count, uint64_t edge_count, OnTypes on_types) {
+    constexpr uint64_t kMax32 = numeric_limits<int32_t>::max();
+    if (vertex_count >= kMax32) {
+        on_types(GraphTypes<int64_t, int64_t>{});
+    } else if (edge_count >= kMax32) {
+        on_types(GraphTypes<int32_t, int64_t>{});
+    } else {
+        on_types(GraphTypes<int32_t, int32_t>{});
+    }
+}
+
+// типы, с которыми сохранён снимок
+template <typename OnTypes>
+void DispatchGraphTypes(const GraphFileHeader& header, OnTypes on_types) {
+    if (header.vertex_id_size == sizeof(int64_t) && header.offset_size == sizeof(int64_t)) {
+        on_types(GraphTypes<int64_t, int64_t>{});
+    } else if (header.vertex_id_size == sizeof(int32_t) && header.offset_size == sizeof(int64_t)) {
+        on_types(GraphTypes<int32_t, int64_t>{});
+    } else if (header.vertex_id_size == sizeof(int32_t) && header.offset_size == sizeof(int32_t)) {
+        on_types(GraphTypes<int32_t, int32_t>{});
+    } else {
+        throw runtime_error("unsupported vertex id or offset types in graph snapshot");
+    }
+}
+
+// Сколько чисел записано в varint-байтах [begin, end): у последнего байта
+// каждого числа старший бит сброшен. SSE2 проверяет по 16 байт за раз.
+#if defined(CHAR_SCAN_X86)
+CHAR_SCAN_TARGET("sse2")
+#endif
+size_t CountVarints(const uint8_t* begin, const uint8_t* end) {
+    size_t count = 0;
+    const uint8_t* pos = begin;
+#if defined(CHAR_SCAN_X86)
+    for (; end - pos >= 16; pos += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        count += 16 - bitset<16>(_mm_movemask_epi8(block)).count();
+    }
+#endif
+    for (; pos != end; ++pos) {
+        count += (*pos & 0x80) == 0;
+    }
+    return count;
+}
+
+// Сжатый список соседей: разности соседних номеров (первая – с номером самой вершины)
+// в zigzag-кодировке, каждая записана как varint (LEB128): по 7 бит в байте,
+// старший бит – «будет ещё байт». Арифметика по модулю 2^k для k-битного VertexId,
+// так что подходит любой номер. Итератор распаковывает числа на лету и хранит
+// текущее число в себе, поэтому он однопроходный (input): ссылка на *it живёт, пока жив it.
+// size() не хранится, а считается по байтам списка – за его длину, а не за O(1)
+template <typename VertexId>
+class VarintList {
+public:
+    using Unsigned = make_unsigned_t<VertexId>;
+
+    class Iterator {
+    public:
+        using iterator_category = input_iterator_tag;
+        using value_type = VertexId;
+        using difference_type = ptrdiff_t;
+        using pointer = const VertexId*;
+        using reference = const VertexId&;
+
+        Iterator() = default;
+
+        Iterator(const uint8_t* pos, const uint8_t* end, VertexId previous)
+            : pos_(pos), end_(end), value_(previous) {
+            Decode();
+        }
+
+        const VertexId& operator*() const {
+            return value_;
+        }
+
+        Iterator& operator++() {
+            pos_ = next_;
+            Decode();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return pos_ == other.pos_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return pos_ != other.pos_;
+        }
+
+    private:
+        void Decode() {
+            next_ = pos_;
+            if (pos_ == end_) {
+                return;
+            }
+            Unsigned zigzag = 0;
+            for (int shift = 0; ; shift += 7) {
+                const uint8_t byte = *next_++;
+                zigzag |= static_cast<Unsigned>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0) {
+                    break;
+                }
+            }
+            const Unsigned delta = (zigzag >> 1) ^ (Unsigned{0} - (zigzag & 1));
+            value_ = static_cast<VertexId>(static_cast<Unsigned>(value_) + delta);
+        }
+
+        const uint8_t* pos_ = nullptr;
+        const uint8_t* end_ = nullptr;
+        const uint8_t* next_ = nullptr;
+        VertexId value_ = 0;
+    };
+
+    VarintList(const uint8_t* begin, const uint8_t* end, VertexId vertex)
+        : begin_(begin), end_(end), vertex_(vertex) {
+    }
+
+    Iterator begin() const {
+        return {begin_, end_, vertex_};
+    }
+
+    Iterator end() const {
+        return {end_, end_, 0};
+    }
+
+    size_t size() const {
+        return CountVarints(begin_, end_);
+    }
+
+    bool empty() const {
+        return begin_ == end_;
+    }
+
+    // дописывает в bytes список vertices (по возрастанию) вершины vertex
+    static void Encode(VertexId vertex, Span<const VertexId> vertices, uint8_t* bytes) {
+        ForEachZigzag(vertex, vertices, [&bytes](Unsigned zigzag) {
+            while (zigzag >= 0x80) {
+                *bytes++ = static_cast<uint8_t>(zigzag | 0x80);
+                zigzag >>= 7;
+            }
+            *bytes++ = static_cast<uint8_t>(zigzag);
+        });
+    }
+
+    static size_t GetEncodedSize(VertexId vertex, Span<const VertexId> vertices) {
+        size_t size = 0;
+        ForEachZigzag(vertex, vertices, [&size](Unsigned zigzag) {
+            do {
+                ++size;
+                zigzag >>= 7;
+            } while (zigzag != 0);
+        });
+        return size;
+    }
+
+private:
+    template <typename OnZigzag>
+    static void ForEachZigzag(VertexId vertex, Span<const VertexId> vertices, OnZigzag on_zigzag) {
+        constexpr int kSignShift = numeric_limits<Unsigned>::digits - 1;
+        Unsigned previous = vertex;
+        for (const VertexId next : vertices) {
+            const Unsigned delta = static_cast<Unsigned>(next) - previous;
+            on_zigzag((delta << 1) ^ (Unsigned{0} - (delta >> kSignShift)));
+            previous = next;
+        }
+    }
+
+    const uint8_t* begin_;
+    const uint8_t* end_;
+    VertexId vertex_;
+};
+
+// Тот же граф только для чтения, но списки детей и родителей сжаты в VarintList.
+// Интерфейс совпадает с Graph, поэтому ComputeSum* работают с ним без изменений.
+// Лучше всего сжимается граф после ReorderVertices: соседи близки к самой вершине,
+// и большинство разностей занимают один байт вместо четырёх (или восьми).
+// Смещения в байтах 32-битные, пока EdgeOffset 32-битный, иначе 64-битные.
+template <typename VertexIdType, typename EdgeOffsetType>
+class CompressedGraph {
+public:
+    using VertexId = VertexIdType;
+    using EdgeOffset = EdgeOffsetType;
+    using ByteOffset = conditional_t<sizeof(EdgeOffset) <= sizeof(uint32_t), uint32_t, uint64_t>;
+
+    explicit CompressedGraph(const BasicGraph<VertexId, EdgeOffset>& graph)
+        : vertex_weights_(graph.GetVertexCount()), edge_count_(graph.GetEdgeCount()) {
+        ThreadPool::Shared().ParallelFor(VertexId{0}, graph.GetVertexCount(), [&](VertexId vertex) {
+            vertex_weights_[vertex] = graph[vertex];
+        });
+        Encode(graph, [&graph](VertexId vertex) { return graph.GetAdjacentVertices(vertex); },
+               offsets_, adjacent_vertices_);
+        Encode(graph, [&graph](VertexId vertex) { return graph.GetParentVertices(vertex); },
+               parent_offsets_, parent_vertices_);
+    }
+
+    VertexId GetVertexCount() const {
+        return vertex_weights_.size();
+    }
+
+    EdgeOffset GetEdgeCount() const {
+        return edge_count_;
+    }
+
+    VarintList<VertexId> GetAdjacentVertices(VertexId vertex) const {
+        return {
+            adjacent_vertices_.data() + offsets_[vertex],
+            adjacent_vertices_.data() + offsets_[vertex + 1],
+            vertex
+        };
+    }
+
+    VarintList<VertexId> GetParentVertices(VertexId vertex) const {
+        return {
+            parent_vertices_.data() + parent_offsets_[vertex],
+            parent_vertices_.data() + parent_offsets_[vertex + 1],
+            vertex
+        };
+    }
+
+    int operator[](VertexId vertex) const {
         return vertex_weights_[vertex];
     }
 
+    // байт на сжатые списки детей и родителей (смещения – столько же, сколько в Graph)
+    size_t GetListBytes() const {
+        return adjacent_vertices_.size() + parent_vertices_.size();
+    }
+
 private:
-    vector<vector<int>> adjacency_lists_;
-    vector<int> vertex_weights_;
+    // размеры списков, префиксная сумма и запись – всё по вершинам параллельно
+    template <typename GetVertices>
+    void Encode(const BasicGraph<VertexId, EdgeOffset>& graph, GetVertices get_vertices,
+                NumaVector<ByteOffset>& offsets, NumaVector<uint8_t>& bytes) {
+        ThreadPool& pool = ThreadPool::Shared();
+        const VertexId vertex_count = graph.GetVertexCount();
+        vector<uint64_t> ends(vertex_count + 1);
+        pool.ParallelFor(VertexId{0}, vertex_count, [&](VertexId vertex) {
+            ends[vertex + 1] = VarintList<VertexId>::GetEncodedSize(vertex, get_vertices(vertex));
+        });
+        inclusive_scan(execution::par, ends.begin(), ends.end(), ends.begin());
+        if (ends.back() > numeric_limits<ByteOffset>::max()) {
+            throw length_error("compressed adjacency does not fit "
+                               + to_string(numeric_limits<ByteOffset>::digits) + "-bit offsets");
+        }
+
+        offsets.assign(ends.begin(), ends.end());
+        bytes.resize(ends.back());
+        pool.ParallelFor(VertexId{0}, vertex_count, [&](VertexId vertex) {
+            VarintList<VertexId>::Encode(vertex, get_vertices(vertex), bytes.data() + offsets[vertex]);
+        });
+    }
+
+    NumaVector<int> vertex_weights_;
+    EdgeOffset edge_count_;
+    NumaVector<ByteOffset> offsets_;
+    NumaVector<uint8_t> adjacent_vertices_;
+    NumaVector<ByteOffset> parent_offsets_;
+    NumaVector<uint8_t> parent_vertices_;
 };
 
-Graph GenerateTree(mt19937& generator, int vertex_count, int max_weight) {
-    Graph graph(vertex_count);
-    for (int vertex = 0; vertex < vertex_count; ++vertex) {
-        graph[vertex] = uniform_int_distribution(0, max_weight)(generator);
+template <typename GraphType = Graph>
+GraphType GenerateTree(mt19937& generator, typename GraphType::VertexId vertex_count, int max_weight) {
+    using VertexId = typename GraphType::VertexId;
+    vector<int> vertex_weights(vertex_count);
+    vector<BasicEdge<VertexId>> edges;
+    edges.reserve(max<VertexId>(vertex_count - 1, 0));
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        vertex_weights[vertex] = uniform_int_distribution(0, max_weight)(generator);
         if (vertex > 0) {
-            const int parent = uniform_int_distribution(0, vertex - 1)(generator);
-            graph.AddEdge(parent, vertex);
+            const VertexId parent = uniform_int_distribution<VertexId>(0, vertex - 1)(generator);
+            edges.push_back({parent, vertex});
+        }
+    }
+    return GraphType(move(vertex_weights), edges);
+}
+
+// Равномерно распределённый номер вершины из [0, bound). Для 32-битных номеров
+// это те же числа, что и раньше, так что 32-битные деревья не меняются
+template <typename VertexId>
+VertexId RandomVertexBelow(CounterRng& generator, VertexId bound) {
+    if constexpr (sizeof(VertexId) <= sizeof(uint32_t)) {
+        return generator.Below(bound);
+    } else {
+        return generator.Below64(bound);
+    }
+}
+
+// Параллельный генератор того же распределения деревьев. Числа для вершины v
+// берутся из счётчикового генератора по номерам 2v и 2v + 1, поэтому дерево
+// зависит только от seed, а не от числа потоков и разбиения на блоки.
+template <typename GraphType = Graph>
+GraphType GenerateTreePar(uint64_t seed, typename GraphType::VertexId vertex_count, int max_weight) {
+    using VertexId = typename GraphType::VertexId;
+    constexpr VertexId kBlockSize = 1 << 16;
+
+    vector<int> vertex_weights(vertex_count);
+    vector<BasicEdge<VertexId>> edges(max<VertexId>(vertex_count - 1, 0));
+    ThreadPool::Shared().ParallelForChunks(
+        VertexId{0}, vertex_count,
+        [seed, max_weight, &vertex_weights, &edges](VertexId begin, VertexId end) {
+            CounterRng generator(seed, 2 * static_cast<uint64_t>(begin));
+            for (VertexId vertex = begin; vertex < end; ++vertex) {
+                vertex_weights[vertex] = generator.Uniform(0, max_weight);
+                const VertexId parent = RandomVertexBelow(generator, max<VertexId>(vertex, 1));
+                if (vertex > 0) {
+                    edges[vertex - 1] = {parent, vertex};
+                }
+            }
+        },
+        kBlockSize
+    );
+    return GraphType(move(vertex_weights), edges);
+}
+
+// Делит текст на куски по границам строк и разбирает их параллельно:
+// parse_chunk(chunk, values) дописывает разобранные значения в свой вектор,
+// затем векторы склеиваются в исходном порядке
+template <typename T, typename ParseChunk>
+vector<T> ParseLinesPar(string_view text, ParseChunk parse_chunk) {
+    constexpr size_t kMinChunkSize = 1 << 20;
+
+    ThreadPool& pool = ThreadPool::Shared();
+    const size_t chunk_count = clamp<size_t>(text.size() / kMinChunkSize, 1, pool.GetThreadCount() * 4);
+    vector<size_t> bounds(chunk_count + 1, text.size());
+    bounds[0] = 0;
+    for (size_t chunk = 1; chunk < chunk_count; ++chunk) {
+        const size_t line_end = text.find('\n', max(bounds[chunk - 1], chunk * text.size() / chunk_count));
+        bounds[chunk] = line_end == string_view::npos ? text.size() : line_end + 1;
+    }
+
+    vector<vector<T>> chunks(chunk_count);
+    pool.ParallelFor(size_t{0}, chunk_count, [&](size_t chunk) {
+        parse_chunk(text.substr(bounds[chunk], bounds[chunk + 1] - bounds[chunk]), chunks[chunk]);
+    }, size_t{1});
+
+    vector<size_t> places(chunk_count);
+    transform_exclusive_scan(
+        chunks.begin(), chunks.end(),
+        places.begin(),
+        size_t{0},
+        plus<>{},
+        [](const vector<T>& values) {
+            return values.size();
+        }
+    );
+    vector<T> result(places.back() + chunks.back().size());
+    pool.ParallelFor(size_t{0}, chunk_count, [&](size_t chunk) {
+        copy(chunks[chunk].begin(), chunks[chunk].end(), result.begin() + places[chunk]);
+    }, size_t{1});
+    return result;
+}
+
+// Читает из текста все неотрицательные целые числа типа Number подряд, пропуская
+// пробельные символы и строки-комментарии, начинающиеся с '#' или '%'
+template <typename Number, typename OnNumber>
+void ParseNumbers(string_view text, OnNumber on_number) {
+    const char* pos = text.data();
+    const char* const end = text.data() + text.size();
+    while (true) {
+        while (pos != end && (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n')) {
+            ++pos;
+        }
+        if (pos == end) {
+            break;
+        }
+        if (*pos == '#' || *pos == '%') {
+            pos = find(pos, end, '\n');
+            continue;
+        }
+        Number value = 0;
+        const auto [next, error] = from_chars(pos, end, value);
+        if (error != errc{} || value < 0) {
+            throw runtime_error("unexpected input: " + string(pos, find(pos, end, '\n')));
+        }
+        on_number(value);
+        pos = next;
+    }
+}
+
+// Рёбра и веса вершин, прочитанные из текста. Номера вершин 64-битные, а граф из них
+// строится с наименьшими подходящими типами (см. DispatchGraphTypes)
+struct EdgeList {
+    vector<int> vertex_weights;
+    vector<BasicEdge<int64_t>> edges;
+};
+
+// Текстовый список рёбер: по строке "from to" на ребро.
+// Файл весов, если задан, содержит веса вершин по порядку; без него все веса равны 1
+EdgeList ReadEdgeList(const string& edges_path, const string& weights_path = "") {
+    using SourceEdge = BasicEdge<int64_t>;
+    vector<SourceEdge> edges;
+    {
+        const MappedFile edges_file(edges_path);
+        edges = ParseLinesPar<SourceEdge>(
+            {edges_file.data(), edges_file.size()},
+            [](string_view chunk, vector<SourceEdge>& edges) {
+                // каждая строка разбирается отдельно: ровно два числа или пустая строка/комментарий
+                while (!chunk.empty()) {
+                    const size_t line_end = min(chunk.find('\n'), chunk.size());
+                    const string_view line = chunk.substr(0, line_end);
+                    chunk.remove_prefix(min(line_end + 1, chunk.size()));
+
+                    int64_t vertices[2] = {};
+                    size_t count = 0;
+                    ParseNumbers<int64_t>(line, [&vertices, &count](int64_t vertex) {
+                        if (count < 2) {
+                            vertices[count] = vertex;
+                        }
+                        ++count;
+                    });
+                    if (count == 0) {
+                        continue;
+                    }
+                    if (count != 2) {
+                        throw runtime_error("edge line must contain exactly two vertices: "
+                                            + string(line.substr(0, line.find_last_not_of('\r') + 1)));
+                    }
+                    edges.push_back({vertices[0], vertices[1]});
+                }
+            }
+        );
+    }
+
+    vector<int> vertex_weights;
+    if (!weights_path.empty()) {
+        const MappedFile weights_file(weights_path);
+        vertex_weights = ParseLinesPar<int>(
+            {weights_file.data(), weights_file.size()},
+            [](string_view chunk, vector<int>& weights) {
+                ParseNumbers<int>(chunk, [&weights](int weight) {
+                    weights.push_back(weight);
+                });
+            }
+        );
+    }
+
+    const int64_t max_vertex = transform_reduce(
+        execution::par,
+        edges.begin(), edges.end(),
+        int64_t{0},
+        [](int64_t lhs, int64_t rhs) {
+            return max(lhs, rhs);
+        },
+        [](const SourceEdge& edge) {
+            return max(edge.from, edge.to);
+        }
+    );
+    const size_t vertex_count = max<size_t>(vertex_weights.size(), max_vertex + 1);
+    vertex_weights.resize(vertex_count, 1);
+    return {move(vertex_weights), move(edges)};
+}
+
+// Все обходы рассчитаны на дерево с корнем 0: у вершины 0 нет родителей, у остальных
+// ровно по одному, и все вершины достижимы из 0. На другом графе они зацикливаются,
+// расходятся в ответах или пишут за границы буферов, поэтому чужой граф проверяется заранее
+template <typename GraphType>
+void CheckTree(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
+    const VertexId vertex_count = graph.GetVertexCount();
+    if (vertex_count == 0) {
+        throw runtime_error("graph is empty, expected a tree rooted at vertex 0");
+    }
+    if (!graph.GetParentVertices(0).empty()) {
+        throw runtime_error("vertex 0 has a parent, expected a tree rooted at vertex 0");
+    }
+
+    // вершина с наименьшим номером, у которой не один родитель
+    atomic<VertexId> wrong_vertex = vertex_count;
+    ThreadPool::Shared().ParallelFor(VertexId{1}, vertex_count, [&graph, &wrong_vertex](VertexId vertex) {
+        if (graph.GetParentVertices(vertex).size() != 1) {
+            VertexId current = wrong_vertex.load(memory_order_relaxed);
+            while (vertex < current && !wrong_vertex.compare_exchange_weak(current, vertex)) {
+            }
         }
+    });
+    if (const VertexId vertex = wrong_vertex.load(); vertex < vertex_count) {
+        throw runtime_error("vertex " + to_string(vertex) + " has "
+                            + to_string(graph.GetParentVertices(vertex).size())
+                            + " parents, expected a tree rooted at vertex 0");
+    }
+
+    // Раз у каждой вершины кроме 0 ровно один родитель, обход из 0 не зайдёт в вершину
+    // дважды, а недостижимыми останутся только циклы в стороне от корня
+    uint64_t reachable = 0;
+    vector<VertexId> frontier = {0};
+    vector<VertexId> next_frontier;
+    while (!frontier.empty()) {
+        reachable += frontier.size();
+        for (const VertexId vertex : frontier) {
+            for (const VertexId child : graph.GetAdjacentVertices(vertex)) {
+                next_frontier.push_back(child);
+            }
+        }
+        frontier.swap(next_frontier);
+        next_frontier.clear();
+    }
+    if (reachable != static_cast<uint64_t>(vertex_count)) {
+        throw runtime_error(to_string(vertex_count - reachable) + " of " + to_string(vertex_count)
+                            + " vertices are not reachable from vertex 0, expected a tree rooted at vertex 0");
     }
-    return graph;
 }
 
-uint64_t ComputeSumSimple(const Graph& graph) {
+enum class VertexOrder {
+    kBfs,           // по уровням обхода из вершины 0, дети – в порядке списков смежности
+    kCuthillMcKee,  // то же, но дети каждой вершины по возрастанию числа их детей
+};
+
+// Новые номера вершин (new_ids[old] = new) в порядке обхода в ширину из вершины 0:
+// корень остаётся нулём, каждый уровень и дети каждой вершины получают подряд идущие номера.
+// Уровень строится параллельно в три прохода: вершина фронта заявляет права на детей
+// (побеждает меньший номер во фронте), считает выигранных, и после префиксной суммы
+// пишет их на свои места. Поэтому порядок тот же, что у последовательного обхода,
+// даже если у вершины несколько родителей. Недостижимые вершины идут в конце по порядку.
+// Обратный шаг RCM не делаем: он увёл бы корень в конец, а все обходы начинаются с 0.
+template <typename GraphType>
+vector<typename GraphType::VertexId> ComputeVertexOrder(const GraphType& graph, VertexOrder order) {
+    using VertexId = typename GraphType::VertexId;
+    constexpr VertexId kFree = numeric_limits<VertexId>::max();
+    constexpr VertexId kVisited = -1;
+    auto won_by = [](VertexId index) {
+        return -2 - index;
+    };
+
+    ThreadPool& pool = ThreadPool::Shared();
+    const VertexId vertex_count = graph.GetVertexCount();
+    vector<VertexId> new_ids(vertex_count, -1);
+    // kFree, номер претендента во фронте, won_by(номер) после подсчёта или kVisited
+    vector<atomic<VertexId>> claims(vertex_count);
+    pool.ParallelFor(VertexId{0}, vertex_count, [&claims](VertexId vertex) {
+        claims[vertex].store(kFree, memory_order_relaxed);
+    });
+
+    vector<VertexId> frontier;
+    vector<VertexId> next_frontier;
+    vector<VertexId> places;
+    if (vertex_count > 0) {
+        frontier.push_back(0);
+        claims[0].store(kVisited, memory_order_relaxed);
+        new_ids[0] = 0;
+    }
+    VertexId next_id = frontier.size();
+    while (!frontier.empty()) {
+        const VertexId frontier_size = frontier.size();
+        pool.ParallelFor(VertexId{0}, frontier_size, [&](VertexId index) {
+            for (const VertexId child : graph.GetAdjacentVertices(frontier[index])) {
+                VertexId claim = claims[child].load(memory_order_relaxed);
+                while (claim > index && !claims[child].compare_exchange_weak(claim, index)) {
+                }
+            }
+        });
+
+        // places[index] – с какого места в next_frontier пишет вершина frontier[index]
+        places.assign(frontier_size + 1, 0);
+        pool.ParallelFor(VertexId{0}, frontier_size, [&](VertexId index) {
+            VertexId won = 0;
+            for (const VertexId child : graph.GetAdjacentVertices(frontier[index])) {
+                VertexId claim = index;
+                won += claims[child].compare_exchange_strong(claim, won_by(index));
+            }
+            places[index + 1] = won;
+        });
+        inclusive_scan(execution::par, places.begin() + 1, places.end(), places.begin() + 1);
+        next_frontier.resize(places.back());
+
+        pool.ParallelFor(VertexId{0}, frontier_size, [&](VertexId index) {
+            VertexId* const begin = next_frontier.data() + places[index];
+            VertexId* end = begin;
+            for (const VertexId child : graph.GetAdjacentVertices(frontier[index])) {
+                VertexId claim = won_by(index);
+                if (claims[child].compare_exchange_strong(claim, kVisited)) {
+                    *end++ = child;
+                }
+            }
+            if (order == VertexOrder::kCuthillMcKee) {
+                stable_sort(begin, end, [&graph](VertexId lhs, VertexId rhs) {
+                    return graph.GetAdjacentVertices(lhs).size() < graph.GetAdjacentVertices(rhs).size();
+                });
+            }
+            for (VertexId* child = begin; child != end; ++child) {
+                new_ids[*child] = next_id + (child - next_frontier.data());
+            }
+        });
+
+        next_id += next_frontier.size();
+        frontier.swap(next_frontier);
+    }
+
+    places.resize(vertex_count);
+    transform_exclusive_scan(
+        execution::par,
+        new_ids.begin(), new_ids.end(),
+        places.begin(),
+        next_id,
+        plus<>{},
+        [](VertexId new_id) {
+            return new_id < 0 ? 1 : 0;
+        }
+    );
+    pool.ParallelFor(VertexId{0}, vertex_count, [&](VertexId vertex) {
+        if (new_ids[vertex] < 0) {
+            new_ids[vertex] = places[vertex];
+        }
+    });
+    return new_ids;
+}
+
+// Тот же граф с вершиной v под номером new_ids[v]: веса и рёбра переставляются вместе,
+// поэтому сумма по уровням от вершины new_ids[0] не меняется
+template <typename GraphType>
+GraphType RenumberVertices(const GraphType& graph, const vector<typename GraphType::VertexId>& new_ids) {
+    using VertexId = typename GraphType::VertexId;
+    using EdgeOffset = typename GraphType::EdgeOffset;
+    ThreadPool& pool = ThreadPool::Shared();
+    const VertexId vertex_count = graph.GetVertexCount();
+    vector<int> vertex_weights(vertex_count);
+    vector<EdgeOffset> degrees(vertex_count);
+    pool.ParallelFor(VertexId{0}, vertex_count, [&](VertexId vertex) {
+        vertex_weights[new_ids[vertex]] = graph[vertex];
+        degrees[vertex] = graph.GetAdjacentVertices(vertex).size();
+    });
+    vector<EdgeOffset> edge_offsets(vertex_count);
+    exclusive_scan(execution::par, degrees.begin(), degrees.end(), edge_offsets.begin(), EdgeOffset{0});
+
+    vector<BasicEdge<VertexId>> edges(graph.GetEdgeCount());
+    pool.ParallelFor(VertexId{0}, vertex_count, [&](VertexId vertex) {
+        BasicEdge<VertexId>* edge = edges.data() + edge_offsets[vertex];
+        for (const VertexId child : graph.GetAdjacentVertices(vertex)) {
+            *edge++ = {new_ids[vertex], new_ids[child]};
+        }
+    });
+    return GraphType(move(vertex_weights), edges);
+}
+
+template <typename GraphType>
+GraphType ReorderVertices(const GraphType& graph, VertexOrder order) {
+    return RenumberVertices(graph, ComputeVertexOrder(graph, order));
+}
+
+template <typename GraphType>
+uint64_t ComputeSumSimple(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
     uint64_t sum = 0;
-    int depth = 0;
-    vector<int> vertices_to_process = { 0 };
-    vector<int> next_vertices;
+    VertexId depth = 0;
+    vector<VertexId> vertices_to_process = { 0 };
+    vector<VertexId> next_vertices;
     while (!vertices_to_process.empty()) {
         ++depth;
-        for (const int vertex_from : vertices_to_process) {
+        for (const VertexId vertex_from : vertices_to_process) {
             sum += static_cast<uint64_t>(graph[vertex_from]) * depth;
-            for (const int vertex_to : graph.GetAdjacentVertices(vertex_from)) {
+            for (const VertexId vertex_to : graph.GetAdjacentVertices(vertex_from)) {
                 next_vertices.push_back(vertex_to);
             }
         }
@@ -75,11 +990,13 @@ uint64_t ComputeSumSimple(const Graph& graph) {
     return sum;
 }
 
-uint64_t ComputeSumFail(const Graph& graph) {
+template <typename GraphType>
+uint64_t ComputeSumFail(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
     uint64_t sum = 0;
-    int depth = 0;
-    vector<int> vertices_to_process = { 0 };
-    vector<int> next_vertices;
+    VertexId depth = 0;
+    vector<VertexId> vertices_to_process = { 0 };
+    vector<VertexId> next_vertices;
     while (!vertices_to_process.empty()) {
         ++depth;
 
@@ -88,7 +1005,7 @@ uint64_t ComputeSumFail(const Graph& graph) {
             vertices_to_process.begin(), vertices_to_process.end(),
             sum,
             plus<>{},
-            [&graph, &next_vertices, depth](int vertex) {
+            [&graph, &next_vertices, depth](VertexId vertex) {
                 const auto& children = graph.GetAdjacentVertices(vertex);
                 copy(
                     children.begin(), children.end(),
@@ -104,17 +1021,20 @@ uint64_t ComputeSumFail(const Graph& graph) {
     return sum;
 }
 
-uint64_t ComputeSumPoolSimple(const Graph& graph) {
+template <typename GraphType>
+uint64_t ComputeSumPoolSimple(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
+    using EdgeOffset = typename GraphType::EdgeOffset;
     uint64_t sum = 0;
-    int depth = 0;
-    const int vertex_count = graph.GetVertexCount();
-    vector<int> pool(vertex_count, 0);
-    for (int from = 0, to = 1, next_to = 1; from < vertex_count; from = to, to = next_to) {
+    VertexId depth = 0;
+    const VertexId vertex_count = graph.GetVertexCount();
+    vector<VertexId> pool(vertex_count, 0);
+    for (EdgeOffset from = 0, to = 1, next_to = 1; from < vertex_count; from = to, to = next_to) {
         ++depth;
-        for (int i = from; i < to; ++i) {
-            const int vertex = pool[i];
+        for (EdgeOffset i = from; i < to; ++i) {
+            const VertexId vertex = pool[i];
             sum += static_cast<uint64_t>(graph[vertex]) * depth;
-            for (const int child : graph.GetAdjacentVertices(vertex)) {
+            for (const VertexId child : graph.GetAdjacentVertices(vertex)) {
                 pool[next_to++] = child;
             }
         }
@@ -122,13 +1042,16 @@ uint64_t ComputeSumPoolSimple(const Graph& graph) {
     return sum;
 }
 
-uint64_t ComputeSumPoolSeq(const Graph& graph) {
+template <typename GraphType>
+uint64_t ComputeSumPoolSeq(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
+    using EdgeOffset = typename GraphType::EdgeOffset;
     uint64_t sum = 0;
-    int depth = 0;
-    const int vertex_count = graph.GetVertexCount();
-    vector<int> pool(vertex_count, 0);
-    vector<int> states(vertex_count);
-    for (int from = 0, to = 1, next_to = 1; from < vertex_count; from = to, to = next_to) {
+    VertexId depth = 0;
+    const VertexId vertex_count = graph.GetVertexCount();
+    vector<VertexId> pool(vertex_count, 0);
+    vector<EdgeOffset> states(vertex_count);
+    for (EdgeOffset from = 0, to = 1, next_to = 1; from < vertex_count; from = to, to = next_to) {
         ++depth;
 
         transform_exclusive_scan(
@@ -137,7 +1060,7 @@ uint64_t ComputeSumPoolSeq(const Graph& graph) {
             states.begin() + from,
             next_to,
             plus<>{},
-            [&graph](int vertex) -> int {
+            [&graph](VertexId vertex) -> EdgeOffset {
                 return graph.GetAdjacentVertices(vertex).size();
             }
         );
@@ -147,7 +1070,7 @@ uint64_t ComputeSumPoolSeq(const Graph& graph) {
             states.begin() + from,
             sum,
             plus<>{},
-            [&graph, &pool, depth, next_to](int vertex, int local_to) {
+            [&graph, &pool, depth, next_to](VertexId vertex, EdgeOffset local_to) {
                 const auto& children = graph.GetAdjacentVertices(vertex);
                 copy(
                     children.begin(), children.end(),
@@ -161,13 +1084,16 @@ uint64_t ComputeSumPoolSeq(const Graph& graph) {
     return sum;
 }
 
-uint64_t ComputeSumPoolPar(const Graph& graph) {
+template <typename GraphType>
+uint64_t ComputeSumPoolPar(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
+    using EdgeOffset = typename GraphType::EdgeOffset;
     uint64_t sum = 0;
-    int depth = 0;
-    const int vertex_count = graph.GetVertexCount();
-    vector<int> pool(vertex_count, 0);
-    vector<int> states(vertex_count);
-    for (int from = 0, to = 1, next_to = 1; from < vertex_count; from = to, to = next_to) {
+    VertexId depth = 0;
+    const VertexId vertex_count = graph.GetVertexCount();
+    vector<VertexId> pool(vertex_count, 0);
+    vector<EdgeOffset> states(vertex_count);
+    for (EdgeOffset from = 0, to = 1, next_to = 1; from < vertex_count; from = to, to = next_to) {
         ++depth;
 
         transform_exclusive_scan(
@@ -176,7 +1102,7 @@ uint64_t ComputeSumPoolPar(const Graph& graph) {
             states.begin() + from,
             next_to,
             plus<>{},
-            [&graph](int vertex) -> int {
+            [&graph](VertexId vertex) -> EdgeOffset {
                 return graph.GetAdjacentVertices(vertex).size();
             }
         );
@@ -186,7 +1112,7 @@ uint64_t ComputeSumPoolPar(const Graph& graph) {
             states.begin() + from,
             sum,
             plus<>{},
-            [&graph, &pool, depth, next_to](int vertex, int local_to) {
+            [&graph, &pool, depth, next_to](VertexId vertex, EdgeOffset local_to) {
                 const auto& children = graph.GetAdjacentVertices(vertex);
                 copy(
                     children.begin(), children.end(),
@@ -200,14 +1126,17 @@ uint64_t ComputeSumPoolPar(const Graph& graph) {
     return sum;
 }
 
-uint64_t ComputeSumSeq(const Graph& graph) {
+template <typename GraphType>
+uint64_t ComputeSumSeq(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
+    using EdgeOffset = typename GraphType::EdgeOffset;
     uint64_t sum = 0;
-    int depth = 0;
-    vector<int> vertices_to_process = { 0 };
-    vector<int> next_vertices;
+    VertexId depth = 0;
+    vector<VertexId> vertices_to_process = { 0 };
+    vector<VertexId> next_vertices;
 
-    const int vertex_count = graph.GetVertexCount();
-    vector<int> states(vertex_count);
+    const VertexId vertex_count = graph.GetVertexCount();
+    vector<EdgeOffset> states(vertex_count);
 
     while (!vertices_to_process.empty()) {
         ++depth;
@@ -218,9 +1147,9 @@ uint64_t ComputeSumSeq(const Graph& graph) {
             execution::seq,
             vertices_to_process.begin(), vertices_to_process.end(),
             states.begin(),
-            0,
+            EdgeOffset{0},
             plus<>{},
-            [&graph](int vertex) -> int {
+            [&graph](VertexId vertex) -> EdgeOffset {
                 return graph.GetAdjacentVertices(vertex).size();
             }
         );
@@ -236,7 +1165,7 @@ uint64_t ComputeSumSeq(const Graph& graph) {
             states.begin(),
             sum,
             plus<>{},
-            [&graph, &next_vertices, depth](int vertex, int local_to) {
+            [&graph, &next_vertices, depth](VertexId vertex, EdgeOffset local_to) {
                 const auto& children = graph.GetAdjacentVertices(vertex);
                 copy(
                     children.begin(), children.end(),
@@ -252,14 +1181,17 @@ uint64_t ComputeSumSeq(const Graph& graph) {
     return sum;
 }
 
-uint64_t ComputeSumPar(const Graph& graph) {
+template <typename GraphType>
+uint64_t ComputeSumPar(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
+    using EdgeOffset = typename GraphType::EdgeOffset;
     uint64_t sum = 0;
-    int depth = 0;
-    vector<int> vertices_to_process = { 0 };
-    vector<int> next_vertices;
+    VertexId depth = 0;
+    NumaVector<VertexId> vertices_to_process = { 0 };
+    NumaVector<VertexId> next_vertices;
 
-    const int vertex_count = graph.GetVertexCount();
-    vector<int> states(vertex_count);
+    const VertexId vertex_count = graph.GetVertexCount();
+    NumaVector<EdgeOffset> states(vertex_count);
 
     while (!vertices_to_process.empty()) {
         ++depth;
@@ -268,9 +1200,9 @@ uint64_t ComputeSumPar(const Graph& graph) {
             execution::par,
             vertices_to_process.begin(), vertices_to_process.end(),
             states.begin(),
-            0,
+            EdgeOffset{0},
             plus<>{},
-            [&graph](int vertex) -> int {
+            [&graph](VertexId vertex) -> EdgeOffset {
                 return graph.GetAdjacentVertices(vertex).size();
             }
         );
@@ -285,7 +1217,7 @@ uint64_t ComputeSumPar(const Graph& graph) {
             states.begin(),
             sum,
             plus<>{},
-            [&graph, &next_vertices, depth](int vertex, int local_to) {
+            [&graph, &next_vertices, depth](VertexId vertex, EdgeOffset local_to) {
                 const auto& children = graph.GetAdjacentVertices(vertex);
                 copy(
                     children.begin(), children.end(),
@@ -301,11 +1233,13 @@ uint64_t ComputeSumPar(const Graph& graph) {
     return sum;
 }
 
-uint64_t ComputeSumMutex(const Graph& graph) {
+template <typename GraphType>
+uint64_t ComputeSumMutex(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
     uint64_t sum = 0;
-    int depth = 0;
-    vector<int> vertices_to_process = { 0 };
-    vector<int> next_vertices;
+    VertexId depth = 0;
+    vector<VertexId> vertices_to_process = { 0 };
+    vector<VertexId> next_vertices;
     next_vertices.reserve(graph.GetVertexCount());
 
     mutex m;
@@ -318,8 +1252,8 @@ uint64_t ComputeSumMutex(const Graph& graph) {
             vertices_to_process.begin(), vertices_to_process.end(),
             sum,
             plus<>{},
-            [&graph, &next_vertices, depth, &m](int vertex) {
-                for (const int child : graph.GetAdjacentVertices(vertex)) {
+            [&graph, &next_vertices, depth, &m](VertexId vertex) {
+                for (const VertexId child : graph.GetAdjacentVertices(vertex)) {
                     lock_guard guard(m);
                     next_vertices.push_back(child);
                 }
@@ -333,28 +1267,66 @@ uint64_t ComputeSumMutex(const Graph& graph) {
     return sum;
 }
 
-uint64_t ComputeSumSafeVectorRace(const Graph& graph) {
+// То же, но без мьютекса: дети дописываются в ConcurrentAppendBuffer,
+// где потоки резервируют место целыми блоками, а фронт склеивается раз за уровень
+template <typename GraphType>
+uint64_t ComputeSumAppendBuffer(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
+    uint64_t sum = 0;
+    VertexId depth = 0;
+    ConcurrentAppendBuffer<VertexId> first(graph.GetVertexCount());
+    ConcurrentAppendBuffer<VertexId> second(graph.GetVertexCount());
+    ConcurrentAppendBuffer<VertexId>* vertices_to_process = &first;
+    ConcurrentAppendBuffer<VertexId>* next_vertices = &second;
+    vertices_to_process->push_back(0);
+    vertices_to_process->Finalize();
+
+    while (!vertices_to_process->empty()) {
+        ++depth;
+
+        sum = transform_reduce(
+            execution::par,
+            vertices_to_process->begin(), vertices_to_process->end(),
+            sum,
+            plus<>{},
+            [&graph, next_vertices, depth](VertexId vertex) {
+                const auto children = graph.GetAdjacentVertices(vertex);
+                next_vertices->Append(children.begin(), children.end());
+                return static_cast<uint64_t>(graph[vertex]) * depth;
+            }
+        );
+
+        next_vertices->Finalize();
+        swap(vertices_to_process, next_vertices);
+        next_vertices->Clear();
+    }
+    return sum;
+}
+
+template <typename GraphType>
+uint64_t ComputeSumSafeVectorRace(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
     uint64_t sum = 0;
-    int depth = 0;
-    vector<int> vertices_to_process = { 0 };
-    vector<int> next_vertices;
+    VertexId depth = 0;
+    vector<VertexId> vertices_to_process = { 0 };
+    vector<VertexId> next_vertices;
 
-    const int vertex_count = graph.GetVertexCount();
+    const VertexId vertex_count = graph.GetVertexCount();
     next_vertices.reserve(vertex_count);
 
     while (!vertices_to_process.empty()) {
         ++depth;
 
         next_vertices.resize(vertex_count);
-        int place = 0;
+        VertexId place = 0;
 
         sum = transform_reduce(
             execution::par,
             vertices_to_process.begin(), vertices_to_process.end(),
             sum,
             plus<>{},
-            [&graph, &next_vertices, depth, &place](int vertex) {
-                for (const int child : graph.GetAdjacentVertices(vertex)) {
+            [&graph, &next_vertices, depth, &place](VertexId vertex) {
+                for (const VertexId child : graph.GetAdjacentVertices(vertex)) {
                     next_vertices[place++] = child;
                 }
                 return static_cast<uint64_t>(graph[vertex]) * depth;
@@ -369,28 +1341,30 @@ uint64_t ComputeSumSafeVectorRace(const Graph& graph) {
     return sum;
 }
 
-uint64_t ComputeSumSafeVectorAtomic(const Graph& graph) {
+template <typename GraphType>
+uint64_t ComputeSumSafeVectorAtomic(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
     uint64_t sum = 0;
-    int depth = 0;
-    vector<int> vertices_to_process = { 0 };
-    vector<int> next_vertices;
+    VertexId depth = 0;
+    vector<VertexId> vertices_to_process = { 0 };
+    vector<VertexId> next_vertices;
 
-    const int vertex_count = graph.GetVertexCount();
+    const VertexId vertex_count = graph.GetVertexCount();
     next_vertices.reserve(vertex_count);
 
     while (!vertices_to_process.empty()) {
         ++depth;
 
         next_vertices.resize(vertex_count);
-        atomic_int place = 0;
+        atomic<VertexId> place = 0;
 
         sum = transform_reduce(
             execution::par,
             vertices_to_process.begin(), vertices_to_process.end(),
             sum,
             plus<>{},
-            [&graph, &next_vertices, depth, &place](int vertex) {
-                for (const int child : graph.GetAdjacentVertices(vertex)) {
+            [&graph, &next_vertices, depth, &place](VertexId vertex) {
+                for (const VertexId child : graph.GetAdjacentVertices(vertex)) {
                     next_vertices[place++] = child;
                 }
                 return static_cast<uint64_t>(graph[vertex]) * depth;
@@ -405,16 +1379,94 @@ uint64_t ComputeSumSafeVectorAtomic(const Graph& graph) {
     return sum;
 }
 
-uint64_t ComputeSumParInner(const Graph& graph) {
+// Кусок следующего фронта, который заполняет один поток. Выровнен по кэш-линии,
+// чтобы соседние буферы не делили одну линию при записи
+template <typename VertexId>
+struct alignas(64) LocalFrontier {
+    vector<VertexId> vertices;
+};
+
+// Каждый поток обрабатывает свой блок текущего фронта и складывает детей в свой буфер,
+// затем буферы склеиваются по префиксным суммам их размеров
+template <typename GraphType>
+uint64_t ComputeSumLocalBuffers(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
+    using EdgeOffset = typename GraphType::EdgeOffset;
+    uint64_t sum = 0;
+    VertexId depth = 0;
+    vector<VertexId> vertices_to_process = { 0 };
+    vector<VertexId> next_vertices;
+
+    // блоков в несколько раз больше, чем потоков, чтобы сгладить неравномерность
+    vector<LocalFrontier<VertexId>> local_frontiers(max(1u, thread::hardware_concurrency()) * 4);
+    vector<EdgeOffset> places(local_frontiers.size());
+
+    while (!vertices_to_process.empty()) {
+        ++depth;
+
+        const size_t block_size =
+            (vertices_to_process.size() + local_frontiers.size() - 1) / local_frontiers.size();
+        sum = transform_reduce(
+            execution::par,
+            local_frontiers.begin(), local_frontiers.end(),
+            sum,
+            plus<>{},
+            [&graph, &vertices_to_process, &local_frontiers, block_size, depth](LocalFrontier<VertexId>& local) {
+                const size_t block = &local - local_frontiers.data();
+                const size_t begin = min(block * block_size, vertices_to_process.size());
+                const size_t end = min(begin + block_size, vertices_to_process.size());
+                uint64_t local_sum = 0;
+                local.vertices.clear();
+                for (size_t i = begin; i < end; ++i) {
+                    const VertexId vertex = vertices_to_process[i];
+                    local_sum += static_cast<uint64_t>(graph[vertex]) * depth;
+                    const auto& children = graph.GetAdjacentVertices(vertex);
+                    local.vertices.insert(local.vertices.end(), children.begin(), children.end());
+                }
+                return local_sum;
+            }
+        );
+
+        transform_exclusive_scan(
+            execution::par,
+            local_frontiers.begin(), local_frontiers.end(),
+            places.begin(),
+            EdgeOffset{0},
+            plus<>{},
+            [](const LocalFrontier<VertexId>& local) -> EdgeOffset {
+                return local.vertices.size();
+            }
+        );
+
+        next_vertices.resize(places.back() + local_frontiers.back().vertices.size());
+        for_each(
+            execution::par,
+            local_frontiers.begin(), local_frontiers.end(),
+            [&local_frontiers, &places, &next_vertices](const LocalFrontier<VertexId>& local) {
+                const size_t block = &local - local_frontiers.data();
+                copy(local.vertices.begin(), local.vertices.end(),
+                     next_vertices.begin() + places[block]);
+            }
+        );
+
+        vertices_to_process.swap(next_vertices);
+        next_vertices.clear();
+    }
+    return sum;
+}
+
+template <typename GraphType>
+uint64_t ComputeSumParInner(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
     uint64_t sum = 0;
-    int depth = 0;
-    vector<int> vertices_to_process = { 0 };
-    vector<int> next_vertices;
+    VertexId depth = 0;
+    vector<VertexId> vertices_to_process = { 0 };
+    vector<VertexId> next_vertices;
     while (!vertices_to_process.empty()) {
         ++depth;
         next_vertices.resize(graph.GetVertexCount());
         auto next_end = next_vertices.begin();
-        for (const int vertex_from : vertices_to_process) {
+        for (const VertexId vertex_from : vertices_to_process) {
             sum += static_cast<uint64_t>(graph[vertex_from]) * depth;
             const auto& children = graph.GetAdjacentVertices(vertex_from);
             next_end = copy(execution::par, children.begin(), children.end(), next_end);
@@ -426,8 +1478,248 @@ uint64_t ComputeSumParInner(const Graph& graph) {
     return sum;
 }
 
-template<typename ComputeSum>
-void Test(ComputeSum compute_sum, string_view label, const Graph& graph) {
+// Битовое множество вершин, которое можно заполнять из нескольких потоков
+class AtomicBitmap {
+public:
+    static constexpr int kWordBits = 64;
+
+    explicit AtomicBitmap(size_t size)
+        : words_((size + kWordBits - 1) / kWordBits) {
+        Clear();
+    }
+
+    void Clear() {
+        for_each(execution::par, words_.begin(), words_.end(), [](atomic_uint64_t& word) {
+            word.store(0, memory_order_relaxed);
+        });
+    }
+
+    bool Test(uint64_t index) const {
+        return (words_[index / kWordBits].load(memory_order_relaxed) >> (index % kWordBits)) & 1;
+    }
+
+    void Set(uint64_t index) {
+        words_[index / kWordBits].fetch_or(uint64_t{1} << (index % kWordBits), memory_order_relaxed);
+    }
+
+    NumaVector<atomic_uint64_t>& GetWords() {
+        return words_;
+    }
+
+    void Swap(AtomicBitmap& other) {
+        words_.swap(other.words_);
+    }
+
+private:
+    NumaVector<atomic_uint64_t> words_;
+};
+
+// Сколько вершин и рёбер в новом фронте и сумма весов его вершин
+struct FrontierStats {
+    uint64_t weight_sum = 0;
+    uint64_t vertex_count = 0;
+    uint64_t edge_count = 0;
+};
+
+FrontierStats operator+(const FrontierStats& lhs, const FrontierStats& rhs) {
+    return {
+        lhs.weight_sum + rhs.weight_sum,
+        lhs.vertex_count + rhs.vertex_count,
+        lhs.edge_count + rhs.edge_count
+    };
+}
+
+// Шаг сверху вниз: из вершин фронта идём в детей, ребёнка забирает тот,
+// кто первым выставил ему родителя
+template <typename GraphType>
+FrontierStats TopDownStep(const GraphType& graph, NumaVector<atomic<typename GraphType::VertexId>>& parents,
+                          const NumaVector<typename GraphType::VertexId>& frontier,
+                          NumaVector<typename GraphType::VertexId>& next_frontier,
+                          NumaVector<typename GraphType::EdgeOffset>& states) {
+    using VertexId = typename GraphType::VertexId;
+    using EdgeOffset = typename GraphType::EdgeOffset;
+    transform_exclusive_scan(
+        execution::par,
+        frontier.begin(), frontier.end(),
+        states.begin(),
+        EdgeOffset{0},
+        plus<>{},
+        [&graph](VertexId vertex) -> EdgeOffset {
+            return graph.GetAdjacentVertices(vertex).size();
+        }
+    );
+    next_frontier.resize(
+        states[frontier.size() - 1] + graph.GetAdjacentVertices(frontier.back()).size());
+
+    const FrontierStats stats = transform_reduce(
+        execution::par,
+        frontier.begin(), frontier.end(),
+        states.begin(),
+        FrontierStats{},
+        plus<>{},
+        [&graph, &parents, &next_frontier](VertexId vertex, EdgeOffset local_to) {
+            FrontierStats stats;
+            for (const VertexId child : graph.GetAdjacentVertices(vertex)) {
+                VertexId expected = -1;
+                if (parents[child].compare_exchange_strong(expected, vertex, memory_order_relaxed)) {
+                    next_frontier[local_to++] = child;
+                    stats = stats + FrontierStats{
+                        static_cast<uint64_t>(graph[child]), 1,
+                        static_cast<uint64_t>(graph.GetAdjacentVertices(child).size())
+                    };
+                } else {
+                    next_frontier[local_to++] = -1;
+                }
+            }
+            return stats;
+        }
+    );
+
+    if (stats.vertex_count < next_frontier.size()) {
+        next_frontier.erase(
+            remove(execution::par, next_frontier.begin(), next_frontier.end(), -1),
+            next_frontier.end());
+    }
+    return stats;
+}
+
+// Шаг снизу вверх: каждая непосещённая вершина ищет родителя во фронте.
+// Одно слово битовой карты обрабатывается целиком одним потоком, поэтому
+// новый фронт заполняется без atomic-операций чтения-записи.
+template <typename GraphType>
+FrontierStats BottomUpStep(const GraphType& graph, NumaVector<atomic<typename GraphType::VertexId>>& parents,
+                           const AtomicBitmap& frontier, AtomicBitmap& next_frontier) {
+    using VertexId = typename GraphType::VertexId;
+    const VertexId vertex_count = graph.GetVertexCount();
+    NumaVector<atomic_uint64_t>& next_words = next_frontier.GetWords();
+    return transform_reduce(
+        execution::par,
+        next_words.begin(), next_words.end(),
+        FrontierStats{},
+        plus<>{},
+        [&graph, &parents, &frontier, &next_words, vertex_count](atomic_uint64_t& word) {
+            FrontierStats stats;
+            uint64_t bits = 0;
+            const VertexId first_vertex = (&word - next_words.data()) * AtomicBitmap::kWordBits;
+            const VertexId last_vertex = min<VertexId>(first_vertex + AtomicBitmap::kWordBits, vertex_count);
+            for (VertexId vertex = first_vertex; vertex < last_vertex; ++vertex) {
+                if (parents[vertex].load(memory_order_relaxed) != -1) {
+                    continue;
+                }
+                for (const VertexId parent : graph.GetParentVertices(vertex)) {
+                    if (frontier.Test(parent)) {
+                        parents[vertex].store(parent, memory_order_relaxed);
+                        bits |= uint64_t{1} << (vertex - first_vertex);
+                        stats = stats + FrontierStats{
+                            static_cast<uint64_t>(graph[vertex]), 1,
+                            static_cast<uint64_t>(graph.GetAdjacentVertices(vertex).size())
+                        };
+                        break;
+                    }
+                }
+            }
+            word.store(bits, memory_order_relaxed);
+            return stats;
+        }
+    );
+}
+
+template <typename VertexId>
+void QueueToBitmap(const NumaVector<VertexId>& queue, AtomicBitmap& bitmap) {
+    bitmap.Clear();
+    for_each(execution::par, queue.begin(), queue.end(), [&bitmap](VertexId vertex) {
+        bitmap.Set(vertex);
+    });
+}
+
+template <typename VertexId, typename EdgeOffset>
+void BitmapToQueue(AtomicBitmap& bitmap, NumaVector<VertexId>& queue, NumaVector<EdgeOffset>& states) {
+    NumaVector<atomic_uint64_t>& words = bitmap.GetWords();
+    auto count_bits = [](const atomic_uint64_t& word) -> EdgeOffset {
+        return bitset<AtomicBitmap::kWordBits>(word.load(memory_order_relaxed)).count();
+    };
+    transform_exclusive_scan(
+        execution::par,
+        words.begin(), words.end(),
+        states.begin(),
+        EdgeOffset{0},
+        plus<>{},
+        count_bits
+    );
+    queue.resize(states[words.size() - 1] + count_bits(words.back()));
+    for_each(execution::par, words.begin(), words.end(), [&](atomic_uint64_t& word) {
+        const size_t word_index = &word - words.data();
+        const uint64_t bits = word.load(memory_order_relaxed);
+        EdgeOffset place = states[word_index];
+        for (int bit = 0; bit < AtomicBitmap::kWordBits; ++bit) {
+            if ((bits >> bit) & 1) {
+                queue[place++] = static_cast<VertexId>(word_index * AtomicBitmap::kWordBits + bit);
+            }
+        }
+    });
+}
+
+// BFS с переключением направления (Beamer et al., "Direction-Optimizing Breadth-First Search"):
+// пока фронт маленький, идём сверху вниз от фронта к детям; когда рёбер из фронта становится
+// много по сравнению с ещё не просмотренными, переходим к шагам снизу вверх по битовой карте.
+// Вес вершины учитывается в момент, когда её обнаружили.
+template <typename GraphType>
+uint64_t ComputeSumDirectionOptimizing(const GraphType& graph) {
+    using VertexId = typename GraphType::VertexId;
+    using EdgeOffset = typename GraphType::EdgeOffset;
+    // пороги из статьи
+    constexpr int kAlpha = 14;
+    constexpr int kBeta = 24;
+
+    const VertexId vertex_count = graph.GetVertexCount();
+    NumaVector<atomic<VertexId>> parents(vertex_count);
+    for_each(execution::par, parents.begin(), parents.end(), [](atomic<VertexId>& parent) {
+        parent.store(-1, memory_order_relaxed);
+    });
+    parents[0] = 0;
+
+    NumaVector<VertexId> frontier = { 0 };
+    NumaVector<VertexId> next_frontier;
+    NumaVector<EdgeOffset> states(vertex_count);
+    AtomicBitmap frontier_bits(vertex_count);
+    AtomicBitmap next_frontier_bits(vertex_count);
+    bool bottom_up = false;
+
+    uint64_t sum = graph[0];
+    int depth = 1;
+    int64_t frontier_size = 1;
+    int64_t frontier_edges = graph.GetAdjacentVertices(0).size();
+    int64_t unexplored_edges = graph.GetEdgeCount() - frontier_edges;
+
+    while (frontier_size > 0) {
+        if (!bottom_up && frontier_edges > unexplored_edges / kAlpha) {
+            QueueToBitmap(frontier, frontier_bits);
+            bottom_up = true;
+        } else if (bottom_up && frontier_size < vertex_count / kBeta) {
+            BitmapToQueue(frontier_bits, frontier, states);
+            bottom_up = false;
+        }
+
+        FrontierStats stats;
+        if (bottom_up) {
+            stats = BottomUpStep(graph, parents, frontier_bits, next_frontier_bits);
+            frontier_bits.Swap(next_frontier_bits);
+        } else {
+            stats = TopDownStep(graph, parents, frontier, next_frontier, states);
+            frontier.swap(next_frontier);
+        }
+
+        ++depth;
+        sum += stats.weight_sum * depth;
+        frontier_size = stats.vertex_count;
+        frontier_edges = stats.edge_count;
+        unexplored_edges -= frontier_edges;
+    }
+    return sum;
+}
+
+template<typename ComputeSum, typename GraphType>
+void Test(ComputeSum compute_sum, string_view label, const GraphType& graph) {
     uint64_t sum;
     {
         LOG_DURATION(label);
@@ -436,12 +1728,15 @@ void Test(ComputeSum compute_sum, string_view label, const Graph& graph) {
     cout << sum << endl;
 }
 
-#define TEST(compute_sum) Test([](const Graph& graph) { return compute_sum(graph); }, #compute_sum, graph)
-
+#define TEST(compute_sum) Test([](const auto& graph) { return compute_sum(graph); }, #compute_sum, graph)
 
-int main() {
-    mt19937 generator(12345);
-    const Graph graph = GenerateTree(generator, 10'000'000, 1'000);
+template <typename GraphType>
+void RunTests(const GraphType& graph) {
+    if (GetNumaPlacement() != NumaPlacement::kDefault) {
+        const Span<const char> storage = graph.GetStorage();
+        const vector<size_t> pages = CountPagesByNode(storage.begin(), storage.size());
+        cerr << "graph pages by NUMA node: " << (pages.empty() ? "unknown" : FormatNodeShares(pages)) << endl;
+    }
 
     // Обычный BFS
     TEST(ComputeSumSimple);
@@ -451,6 +1746,7 @@ int main() {
 
     // Добавляем мьютекс
     TEST(ComputeSumMutex);
+    TEST(ComputeSumAppendBuffer);  // без блокировок: место резервируется блоками
 
     // Можно не конфликтовать за вставку в вектор, если для каждой вершины текущего вектора знать,
     // куда вставлять её детей
@@ -467,6 +1763,116 @@ int main() {
     TEST(ComputeSumSafeVectorRace);
     TEST(ComputeSumSafeVectorAtomic);  // спасает atomic-счётчик
 
+    // Без общего счётчика: каждый поток пишет детей в свой буфер,
+    // буферы склеиваются один раз за уровень
+    TEST(ComputeSumLocalBuffers);
+
+    // Переключаемся между обходом сверху вниз и снизу вверх в зависимости от размера фронта
+    TEST(ComputeSumDirectionOptimizing);
+
+    // Перенумеровываем вершины в порядке обхода: дети одной вершины и соседние вершины
+    // фронта лежат рядом, и обход читает веса почти подряд. Сумма та же
+    for (const auto& [order, label] : {
+            pair{VertexOrder::kBfs, "ReorderVertices(kBfs)"},
+            pair{VertexOrder::kCuthillMcKee, "ReorderVertices(kCuthillMcKee)"}}) {
+        const GraphType reordered = [&graph, order = order, label = label] {
+            LOG_DURATION(label);
+            return ReorderVertices(graph, order);
+        }();
+        {
+            const GraphType& graph = reordered;
+            TEST(ComputeSumSimple);
+            TEST(ComputeSumPar);
+            TEST(ComputeSumLocalBuffers);
+            TEST(ComputeSumDirectionOptimizing);
+        }
+
+        // Те же обходы по сжатым спискам: читаем меньше байт за уровень
+        const CompressedGraph compressed = [&reordered] {
+            LOG_DURATION("CompressedGraph");
+            return CompressedGraph(reordered);
+        }();
+        cerr << "adjacency lists: " << compressed.GetListBytes() << " bytes compressed, "
+             << 2 * reordered.GetEdgeCount() * sizeof(typename GraphType::VertexId) << " bytes uncompressed" << endl;
+        const auto& graph = compressed;
+        TEST(ComputeSumSimple);
+        TEST(ComputeSumPar);
+        TEST(ComputeSumLocalBuffers);
+        TEST(ComputeSumDirectionOptimizing);
+    }
+
     // внутренний цикл не ускоряется
     // TEST(ComputeSumParInner);
 }
+
+
+// Аргументы:
+//   [--vertices <n>] – сколько вершин в генерируемом дереве (по умолчанию 10 000 000);
+//                      начиная с 2^31 номера вершин и смещения 64-битные;
+//   [--numa <interleave|partition|off>] – как размещать граф и рабочие массивы обходов
+//                      по NUMA-узлам; потоки пула при этом закрепляются за узлами.
+//                      На машине с одним узлом ничего не меняет;
+//   <snapshot> – путь к снимку графа; если файла ещё нет, граф генерируется
+//                и сохраняется туда для следующих запусков;
+//   --edges <edge list> [<weights>] – граф из текстового списка рёбер
+int main(int argc, char* argv[]) {
+    vector<string_view> args(argv + 1, argv + argc);
+    uint64_t vertex_count = 10'000'000;
+    while (args.size() > 1 && (args[0] == "--vertices" || args[0] == "--numa")) {
+        if (args[0] == "--vertices") {
+            vertex_count = stoull(string(args[1]));
+        } else {
+            SetNumaPlacement(ParseNumaPlacement(args[1]));
+        }
+        args.erase(args.begin(), args.begin() + 2);
+    }
+    if (GetNumaPlacement() != NumaPlacement::kDefault) {
+        const vector<size_t> pinned = PinThreadPool(ThreadPool::Shared());
+        cerr << "NUMA nodes: " << NumaTopology::Get().GetNodeCount() << ", pool threads by node: "
+             << (pinned.empty() ? "not pinned" : FormatNodeShares(pinned)) << endl;
+    }
+
+    if (args.size() > 1 && args[0] == "--edges") {
+        EdgeList edge_list = [&args] {
+            LOG_DURATION("ReadEdgeList");
+            return ReadEdgeList(string(args[1]), args.size() > 2 ? string(args[2]) : "");
+        }();
+        DispatchGraphTypes(edge_list.vertex_weights.size(), edge_list.edges.size(), [&edge_list](auto types) {
+            using GraphType = typename decltype(types)::Graph;
+            const GraphType graph = [&edge_list] {
+                LOG_DURATION("BuildGraph");
+                return GraphType(move(edge_list.vertex_weights), edge_list.edges);
+            }();
+            edge_list = {};
+            CheckTree(graph);
+            RunTests(graph);
+        });
+        return 0;
+    }
+
+    const string snapshot_path = args.empty() ? "" : string(args[0]);
+    if (!snapshot_path.empty() && ifstream(snapshot_path)) {
+        DispatchGraphTypes(ReadGraphFileHeader(snapshot_path), [&snapshot_path](auto types) {
+            using GraphType = typename decltype(types)::Graph;
+            const GraphType graph = [&snapshot_path] {
+                LOG_DURATION("Graph::Load");
+                return GraphType::Load(snapshot_path);
+            }();
+            RunTests(graph);
+        });
+        return 0;
+    }
+
+    DispatchGraphTypes(vertex_count, max<uint64_t>(vertex_count, 1) - 1, [&](auto types) {
+        using GraphType = typename decltype(types)::Graph;
+        const GraphType graph = [vertex_count] {
+            LOG_DURATION("GenerateTreePar");
+            return GenerateTreePar<GraphType>(12345, vertex_count, 1'000);
+        }();
+        if (!snapshot_path.empty()) {
+            LOG_DURATION("Graph::Save");
+            graph.Save(snapshot_path);
+        }
+        RunTests(graph);
+    });
+}
@@ -1,13 +1,25 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <future>
 #include <iostream>
+#include <limits>
+#include <list>
+#include <mutex>
 #include <random>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "counter_rng.h"
+#include "parallel_sort.h"
 #include "profile.h"
+#include "sorted_lookup.h"
+#include "thread_pool.h"
 
 using namespace std;
 
@@ -20,18 +32,124 @@ vector<int> GenerateNumbers(mt19937& generator, int count, int max_value) {
     return numbers;
 }
 
+// То же параллельно: i-е число – i-е число генератора CounterRng(seed), так что
+// результат зависит только от seed, а не от числа потоков или разбиения на блоки.
+vector<int> GenerateNumbersPar(uint64_t seed, size_t count, int max_value) {
+    vector<int> numbers(count);
+    ThreadPool::Shared().ParallelForChunks(size_t{0}, count, [&](size_t begin, size_t end) {
+        CounterRng generator(seed, begin);
+        for (size_t i = begin; i < end; ++i) {
+            numbers[i] = generator.Uniform(0, max_value);
+        }
+    });
+    ParallelSort(numbers);
+    return numbers;
+}
+
 bool CheckNumber(int x) {
     // Emulate very expensive check.
     this_thread::sleep_for(100ms);
     return x > 100'000'000;
 }
 
-int FindSimple(const vector<int>& numbers) {
+// Та же проверка, но её можно прервать: «удалённый» запрос время от времени смотрит
+// на флаг отмены и бросает работу, если результат уже никому не нужен.
+bool CheckNumberCancellable(int x, const atomic<bool>& cancelled) {
+    for (int step = 0; step < 20 && !cancelled.load(memory_order_relaxed); ++step) {
+        this_thread::sleep_for(5ms);
+    }
+    return x > 100'000'000;
+}
+
+// Кэш монотонного предиката по индексу, общий для всех потоков. Помнит наибольший индекс
+// с ответом false и наименьший с true: левее первого всё false, правее второго всё true,
+// такие индексы не проверяются повторно (поэтому отдельно хранить ответы не нужно).
+// Одновременные запросы одного и того же индекса ждут одну проверку.
+template <typename Predicate>
+class MonotoneCache {
+public:
+    struct Stats {
+        int evaluated = 0;           // реальных вызовов предиката
+        int answered_by_bounds = 0;  // ответов по известным границам
+        int coalesced = 0;           // запросов, дождавшихся чужой проверки
+    };
+
+    explicit MonotoneCache(Predicate predicate)
+        : predicate_(move(predicate))
+    {
+    }
+
+    bool operator()(int index) {
+        unique_lock lock(m_);
+        if (index <= max_false_ || index >= min_true_) {
+            ++stats_.answered_by_bounds;
+            return index >= min_true_;
+        }
+        if (const auto it = pending_.find(index); it != pending_.end()) {
+            ++stats_.coalesced;
+            shared_future<bool> result = it->second;
+            lock.unlock();
+            return result.get();
+        }
+        promise<bool> result;
+        pending_.emplace(index, result.get_future().share());
+        ++stats_.evaluated;
+        lock.unlock();
+
+        bool value;
+        try {
+            value = predicate_(index);
+        } catch (...) {
+            lock.lock();
+            pending_.erase(index);
+            result.set_exception(current_exception());
+            throw;
+        }
+
+        lock.lock();
+        if (value) {
+            min_true_ = min(min_true_, index);
+        } else {
+            max_false_ = max(max_false_, index);
+        }
+        pending_.erase(index);
+        result.set_value(value);
+        return value;
+    }
+
+    Stats GetStats() const {
+        lock_guard lock(m_);
+        return stats_;
+    }
+
+private:
+    Predicate predicate_;
+    mutable mutex m_;
+    int max_false_ = numeric_limits<int>::min();
+    int min_true_ = numeric_limits<int>::max();
+    unordered_map<int, shared_future<bool>> pending_;
+    Stats stats_;
+};
+
+// CheckNumber для элемента numbers по его индексу
+auto CheckAt(const vector<int>& numbers) {
+    return [&numbers](int index) { return CheckNumber(numbers[index]); };
+}
+
+auto MakeCheckCache(const vector<int>& numbers) {
+    return MonotoneCache(CheckAt(numbers));
+}
+
+// Стратегии ниже принимают проверку по индексу check_index, чтобы её можно было
+// заменить кэшем; перегрузки без неё проверяют CheckNumber напрямую.
+
+template <typename CheckIndex>
+int FindSimple(const vector<int>& numbers, CheckIndex check_index) {
     int left = -1;
     int right = numbers.size();
     while (left + 1 < right) {
         const int med = (left + right) / 2;
-        if (CheckNumber(numbers[med])) {
+        if (check_index(med)) {
             right = med;
         } else {
             left = med;
@@ -40,15 +158,20 @@ int FindSimple(const vector<int>& numbers) {
     return right;
 }
 
-int Find3PartsSeq(const vector<int>& numbers) {
+int FindSimple(const vector<int>& numbers) {
+    return FindSimple(numbers, CheckAt(numbers));
+}
+
+template <typename CheckIndex>
+int Find3PartsSeq(const vector<int>& numbers, CheckIndex check_index) {
     int left = -1;
     int right = numbers.size();
     while (left + 1 < right) {
         const int dist = max(1, (right - left) / 3);
         const int med1 = left + dist;
         const int med2 = right - dist;
-        const bool res1 = CheckNumber(numbers[med1]);
-        const bool res2 = CheckNumber(numbers[med2]);
+        const bool res1 = check_index(med1);
+        const bool res2 = check_index(med2);
         if (res1) {
             right = med1;
         } else if (!res2) {
@@ -61,6 +184,10 @@ int Find3PartsSeq(const vector<int>& numbers) {
     return right;
 }
 
+int Find3PartsSeq(const vector<int>& numbers) {
+    return Find3PartsSeq(numbers, CheckAt(numbers));
+}
+
 int Find3PartsPar(const vector<int>& numbers) {
     int left = -1;
     int right = numbers.size();
@@ -85,7 +212,34 @@ int Find3PartsPar(const vector<int>& numbers) {
     return right;
 }
 
-int Find4PartsPar(const vector<int>& numbers) {
+// то же, но проверка уходит в общий пул, а не в новый поток std::async
+int Find3PartsPool(const vector<int>& numbers) {
+    ThreadPool& pool = ThreadPool::Shared();
+    int left = -1;
+    int right = numbers.size();
+    while (left + 1 < right) {
+        const int dist = max(1, (right - left) / 3);
+        const int med1 = left + dist;
+        const int med2 = right - dist;
+
+        future<bool> future1 = pool.Submit([x = numbers[med1]] { return CheckNumber(x); });
+        const bool res2 = CheckNumber(numbers[med2]);
+        const bool res1 = pool.Wait(future1);
+
+        if (res1) {
+            right = med1;
+        } else if (!res2) {
+            left = med2;
+        } else {
+            left = med1;
+            right = med2;
+        }
+    }
+    return right;
+}
+
+template <typename CheckIndex>
+int Find4PartsPar(const vector<int>& numbers, CheckIndex check_index) {
     int left = -1;
     int right = numbers.size();
     while (left + 1 < right) {
@@ -94,9 +248,9 @@ int Find4PartsPar(const vector<int>& numbers) {
         const int med2 = med1 + dist;
         const int med3 = right - dist;
 
-        future<bool> future1 = async(CheckNumber, numbers[med1]);
-        future<bool> future2 = async(CheckNumber, numbers[med2]);
-        const bool res3 = CheckNumber(numbers[med3]);
+        future<bool> future1 = async(check_index, med1);
+        future<bool> future2 = async(check_index, med2);
+        const bool res3 = check_index(med3);
         const bool res1 = future1.get();
         const bool res2 = future2.get();
 
@@ -115,8 +269,165 @@ int Find4PartsPar(const vector<int>& numbers) {
     return right;
 }
 
+int Find4PartsPar(const vector<int>& numbers) {
+    return Find4PartsPar(numbers, CheckAt(numbers));
+}
+
+// Один раунд поиска с P = bounds.size() - 1 частями: P - 1 параллельных проверок
+// сужают (left, right) до одной части. bounds и futures – std::array для P, известного
+// при компиляции, или std::vector для выбранного во время выполнения.
+template <typename Bounds, typename Futures, typename CheckIndex>
+void SearchRoundPar(Bounds& bounds, Futures& futures, const CheckIndex& check_index, int& left, int& right) {
+    const int P = bounds.size() - 1;
+    const int dist = max(1, (right - left) / P);
+    for (int i = 0; i < P - 1; ++i) {
+        bounds[i] = left + dist * i;
+    }
+    bounds[P] = right;
+    bounds[P - 1] = right - dist;
+
+    for (int i = 1; i < P; ++i) {
+        futures[i] = async(check_index, bounds[i]);
+    }
+
+    for (int i = 1; i <= P; ++i) {
+        if (i == P || futures[i].get()) {
+            left = bounds[i - 1];
+            right = bounds[i];
+            break;
+        }
+    }
+}
+
+template <int P, typename CheckIndex>
+void SearchRoundPar(const CheckIndex& check_index, int& left, int& right) {
+    array<int, P + 1> bounds;
+    array<future<bool>, P + 1> futures;
+    SearchRoundPar(bounds, futures, check_index, left, right);
+}
+
+template <int P, typename CheckIndex>
+int FindNBoundsPar(const vector<int>& numbers, CheckIndex check_index) {
+    int left = -1;
+    int right = numbers.size();
+    while (left + 1 < right) {
+        SearchRoundPar<P>(check_index, left, right);
+    }
+    return right;
+}
+
+// раунд с числом частей parts, известным только во время выполнения;
+// для частых значений – те же инстанцирования, что и у FindNBoundsPar<P>
+template <typename CheckIndex>
+void SearchRoundPar(int parts, const CheckIndex& check_index, int& left, int& right) {
+    switch (parts) {
+    case 2:
+        return SearchRoundPar<2>(check_index, left, right);
+    case 3:
+        return SearchRoundPar<3>(check_index, left, right);
+    case 4:
+        return SearchRoundPar<4>(check_index, left, right);
+    case 8:
+        return SearchRoundPar<8>(check_index, left, right);
+    case 16:
+        return SearchRoundPar<16>(check_index, left, right);
+    default: {
+        vector<int> bounds(parts + 1);
+        vector<future<bool>> futures(parts + 1);
+        SearchRoundPar(bounds, futures, check_index, left, right);
+    }
+    }
+}
+
+// Число частей, за которое быстрее всего сузить интервал длины interval до одной точки,
+// если раунд с parts частями длится check_latency + probe_overhead * (parts - 2).
+int ChooseFanOut(double check_latency, double probe_overhead, int interval) {
+    static constexpr int kMaxFanOut = 64;  // больше проверок за раунд не запускаем
+    int best_parts = 2;
+    double best_cost = numeric_limits<double>::max();
+    for (int parts = 2; parts <= min(kMaxFanOut, interval); ++parts) {
+        int round_count = 0;
+        for (int width = interval; width > 1; width = (width + parts - 1) / parts) {
+            ++round_count;
+        }
+        const double cost = round_count * (check_latency + probe_overhead * (parts - 2));
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_parts = parts;
+        }
+    }
+    return best_parts;
+}
+
+// FindNBoundsPar без угадывания P: число частей выбирается перед каждым раундом.
+// Длительности прошедших раундов приближаются прямой от числа проверок: свободный член –
+// время одной проверки, наклон – сколько добавляет каждая лишняя проверка (накладные
+// расходы, нехватка ядер). По ней и по оставшемуся интервалу ChooseFanOut ищет лучшее
+// число частей. Первый раунд – по проверке на ядро; пока все раунды были одного размера,
+// наклон не измерить, и следующий раунд пробный – вдвое больше.
+template <typename CheckIndex>
+int FindNBoundsAdaptive(const vector<int>& numbers, CheckIndex check_index) {
+    const int core_count = max(1u, thread::hardware_concurrency());
+    // суммы для МНК по точкам (лишних проверок, длительность раунда)
+    double n = 0, sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    vector<int> fan_outs;
+    int left = -1;
+    int right = numbers.size();
+    while (left + 1 < right) {
+        int parts = min(core_count + 1, right - left);
+        const double variance = n * sum_xx - sum_x * sum_x;
+        if (n > 0 && variance <= 0) {
+            parts = min(2 * fan_outs.back(), right - left);
+        } else if (n > 0) {
+            const double slope = max(0.0, (n * sum_xy - sum_x * sum_y) / variance);
+            const double latency = max(0.0, (sum_y - slope * sum_x) / n);
+            parts = ChooseFanOut(latency, slope, right - left);
+        }
+
+        const auto round_start = chrono::steady_clock::now();
+        SearchRoundPar(parts, check_index, left, right);
+        const double x = parts - 2;
+        const double y = chrono::duration<double>(chrono::steady_clock::now() - round_start).count();
+        n += 1;
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+        fan_outs.push_back(parts);
+    }
+
+    cerr << "fan-out per round:";
+    for (int parts : fan_outs) {
+        cerr << " " << parts;
+    }
+    cerr << endl;
+    return right;
+}
+
+int FindNBoundsAdaptive(const vector<int>& numbers) {
+    return FindNBoundsAdaptive(numbers, CheckAt(numbers));
+}
+
+// то же с вычислительной проверкой: она занимает ядро, и при малом числе ядер
+// выгоднее меньше частей и больше раундов
+int FindNBoundsAdaptiveBusy(const vector<int>& numbers) {
+    return FindNBoundsAdaptive(numbers, [&numbers](int index) {
+        volatile uint64_t state = index;
+        for (int i = 0; i < 10'000'000; ++i) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+        }
+        return numbers[index] > 100'000'000;
+    });
+}
+
 template <int P>
 int FindNBoundsPar(const vector<int>& numbers) {
+    return FindNBoundsPar<P>(numbers, CheckAt(numbers));
+}
+
+template <int P>
+int FindNBoundsPool(const vector<int>& numbers) {
+    ThreadPool& pool = ThreadPool::Shared();
     int left = -1;
     int right = numbers.size();
     while (left + 1 < right) {
@@ -130,21 +441,210 @@ int FindNBoundsPar(const vector<int>& numbers) {
         bounds[P - 1] = right - dist;
 
         for (int i = 1; i < P; ++i) {
-            futures[i] = async(CheckNumber, numbers[bounds[i]]);
+            futures[i] = pool.Submit([x = numbers[bounds[i]]] { return CheckNumber(x); });
         }
 
         for (int i = 1; i <= P; ++i) {
-            if (i == P || futures[i].get()) {
+            if (i == P || pool.Wait(futures[i])) {
                 left = bounds[i - 1];
                 right = bounds[i];
                 break;
             }
         }
+        // дожидаемся оставшихся проверок, чтобы они не занимали пул в следующем раунде
+        for (int i = 1; i < P; ++i) {
+            if (futures[i].valid()) {
+                futures[i].wait();
+            }
+        }
     }
     return right;
 }
 
+struct SearchStats {
+    int started = 0;    // сколько проверок запущено
+    int cancelled = 0;  // из них отменено: результат перестал быть нужен
+    int useful = 0;     // сколько результатов сузили интервал
+};
+
+// Спекулятивный k-арный поиск: probe_count потоков всё время заняты проверками внутри
+// текущего интервала (left, right). Освободившийся поток не ждёт конца раунда, а сразу
+// проверяет середину самого большого промежутка между границами и уже идущими проверками.
+// Как только результат сужает интервал, проверки за его пределами отменяются.
+template <typename Predicate>
+int FindSpeculative(const vector<int>& numbers, int probe_count, Predicate predicate,
+                    SearchStats* stats = nullptr) {
+    struct Probe {
+        explicit Probe(int index)
+            : index(index)
+        {
+        }
+
+        const int index;
+        atomic<bool> cancelled = false;
+    };
+
+    mutex m;
+    condition_variable probe_finished;
+    int left = -1;
+    int right = numbers.size();
+    list<Probe> probes;  // идущие проверки, ссылки на элементы не меняются
+    SearchStats local_stats;
+
+    // середина самого большого промежутка, или -1, если все точки интервала уже проверяются
+    auto pick_index = [&] {
+        vector<int> points = {left, right};
+        for (const Probe& probe : probes) {
+            if (!probe.cancelled.load(memory_order_relaxed)) {
+                points.push_back(probe.index);
+            }
+        }
+        sort(points.begin(), points.end());
+        int best = 0;
+        for (size_t i = 1; i < points.size(); ++i) {
+            if (points[i] - points[i - 1] > points[best + 1] - points[best]) {
+                best = i - 1;
+            }
+        }
+        const int gap = points[best + 1] - points[best];
+        return gap < 2 ? -1 : points[best] + gap / 2;
+    };
+
+    auto worker = [&] {
+        unique_lock lock(m);
+        while (left + 1 < right) {
+            const int index = pick_index();
+            if (index < 0) {
+                probe_finished.wait(lock);
+                continue;
+            }
+            Probe& probe = probes.emplace_back(index);
+            const auto it = prev(probes.end());
+            ++local_stats.started;
+
+            lock.unlock();
+            const bool result = predicate(numbers[index], probe.cancelled);
+            lock.lock();
+
+            // неотменённая проверка всегда лежит внутри текущего интервала
+            if (probe.cancelled.load(memory_order_relaxed)) {
+                ++local_stats.cancelled;
+            } else {
+                ++local_stats.useful;
+                (result ? right : left) = index;
+                for (Probe& other : probes) {
+                    if (other.index <= left || other.index >= right) {
+                        other.cancelled.store(true, memory_order_relaxed);
+                    }
+                }
+            }
+            probes.erase(it);
+            probe_finished.notify_all();
+        }
+    };
+
+    vector<thread> threads;
+    for (int i = 1; i < probe_count; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (thread& t : threads) {
+        t.join();
+    }
+    if (stats) {
+        *stats = local_stats;
+    }
+    return right;
+}
+
+template <int P>
+int FindSpeculativePar(const vector<int>& numbers) {
+    SearchStats stats;
+    const int result = FindSpeculative(numbers, P, CheckNumberCancellable, &stats);
+    cerr << "checks: " << stats.started << " started, " << stats.cancelled << " cancelled, "
+         << stats.useful << " useful" << endl;
+    return result;
+}
+
+// подготовка входных данных: последовательно и параллельно
+void BenchmarkGeneration(size_t count) {
+    vector<int> expected;
+    {
+        LOG_DURATION("GenerateNumbers");
+        mt19937 generator;
+        expected = GenerateNumbers(generator, count, 1'000'000'000);
+    }
+    vector<int> numbers;
+    {
+        LOG_DURATION("GenerateNumbersPar");
+        numbers = GenerateNumbersPar(12345, count, 1'000'000'000);
+    }
+    cout << (is_sorted(numbers.begin(), numbers.end()) ? "sorted" : "NOT SORTED") << endl;
+    {
+        LOG_DURATION("ParallelMergeSort");
+        shuffle(expected.begin(), expected.end(), mt19937());
+        ParallelMergeSort(expected);
+    }
+    cout << (is_sorted(expected.begin(), expected.end()) ? "sorted" : "NOT SORTED") << endl;
+}
+
+// много поисков по одному массиву: пакетные варианты против std::lower_bound по одному ключу
+void BenchmarkLowerBound(const vector<int>& numbers, mt19937& generator, int key_count) {
+    vector<int> keys(key_count);
+    for (int& key : keys) {
+        key = uniform_int_distribution(-1, 1'000'000'001)(generator);
+    }
+
+    vector<int> expected(keys.size());
+    {
+        LOG_DURATION("std::lower_bound");
+        for (size_t i = 0; i < keys.size(); ++i) {
+            expected[i] = lower_bound(numbers.begin(), numbers.end(), keys[i]) - numbers.begin();
+        }
+    }
+    auto check = [&expected](const vector<int>& positions) {
+        cout << (positions == expected ? "OK" : "WRONG") << endl;
+    };
+    {
+        LOG_DURATION("LowerBoundBatch scalar");
+        check(LowerBoundBatch(numbers, keys, SimdLevel::kScalar));
+    }
+    {
+        LOG_DURATION("LowerBoundBatch");
+        check(LowerBoundBatch(numbers, keys));
+    }
+    {
+        LOG_DURATION("LowerBoundBatchPar");
+        check(LowerBoundBatchPar(numbers, keys));
+    }
+    EytzingerArray eytzinger = [&] {
+        LOG_DURATION("EytzingerArray build");
+        return EytzingerArray(numbers);
+    }();
+    {
+        LOG_DURATION("EytzingerArray::LowerBoundBatch");
+        check(eytzinger.LowerBoundBatch(keys));
+    }
+    {
+        LOG_DURATION("EytzingerArray::LowerBoundBatchPar");
+        check(eytzinger.LowerBoundBatchPar(keys));
+    }
+}
+
 #define TEST(f) { LOG_DURATION(#f); cout << f(numbers) << endl; }
+#define TEST_CACHED(f) { \
+    LOG_DURATION(#f " cached"); \
+    auto cache = MakeCheckCache(numbers); \
+    cout << f(numbers, ref(cache)) << endl; \
+    PrintCacheStats(cache); \
+}
+
+template <typename Cache>
+void PrintCacheStats(const Cache& cache) {
+    const auto stats = cache.GetStats();
+    cerr << "checks: " << stats.evaluated << " evaluated, " << stats.answered_by_bounds
+         << " answered by bounds, " << stats.coalesced << " coalesced" << endl;
+}
 
 int main() {
     mt19937 generator;
@@ -152,6 +652,7 @@ int main() {
     TEST(FindSimple);
     TEST(Find3PartsSeq);
     TEST(Find3PartsPar);
+    TEST(Find3PartsPool);
     TEST(Find4PartsPar);
     TEST(FindNBoundsPar<2>);
     TEST(FindNBoundsPar<3>);
@@ -164,5 +665,31 @@ int main() {
     TEST(FindNBoundsPar<10>);
     TEST(FindNBoundsPar<11>);
     TEST(FindNBoundsPar<12>);
+    TEST(FindNBoundsAdaptive);
+    TEST(FindNBoundsAdaptiveBusy);
+    TEST(FindNBoundsPool<2>);
+    TEST(FindNBoundsPool<4>);
+    TEST(FindNBoundsPool<8>);
+    TEST(FindNBoundsPool<12>);
+    TEST(FindSpeculativePar<2>);
+    TEST(FindSpeculativePar<4>);
+    TEST(FindSpeculativePar<8>);
+    TEST(FindSpeculativePar<12>);
+    TEST_CACHED(FindSimple);
+    TEST_CACHED(Find3PartsSeq);
+    TEST_CACHED(Find4PartsPar);
+    TEST_CACHED(FindNBoundsPar<4>);
+    TEST_CACHED(FindNBoundsPar<12>);
+    {
+        // один кэш на несколько поисков: следующий почти целиком отвечается границами
+        LOG_DURATION("Shared cache");
+        auto cache = MakeCheckCache(numbers);
+        cout << FindNBoundsPar<4>(numbers, ref(cache)) << endl;
+        cout << FindSimple(numbers, ref(cache)) << endl;
+        cout << Find3PartsSeq(numbers, ref(cache)) << endl;
+        PrintCacheStats(cache);
+    }
+    BenchmarkLowerBound(numbers, generator, 10'000'000);
+    BenchmarkGeneration(100'000'000);
     return 0;
 }
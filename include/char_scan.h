@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  #define CHAR_SCAN_X86
+  #include <immintrin.h>
+  #if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+    // MSVC разрешает интринсики любого набора инструкций без флагов компиляции
+    #define CHAR_SCAN_TARGET(features)
+  #else
+    #define CHAR_SCAN_TARGET(features) __attribute__((target(features)))
+  #endif
+#endif
+
+// Поиск всех вхождений символа в тексте: сравниваем сразу 16 (SSE2) или 32 (AVX2) байта,
+// movemask даёт битовую маску совпадений, по которой идём от младших битов к старшим.
+// Набор инструкций выбирается во время выполнения, на остальных платформах – скалярный цикл.
+
+enum class SimdLevel {
+  kScalar,
+  kSse2,
+  kAvx2,
+};
+
+inline SimdLevel DetectSimdLevel() {
+#if defined(CHAR_SCAN_X86)
+  #if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  const int max_leaf = info[0];
+  __cpuid(info, 1);
+  const bool has_sse2 = (info[3] >> 26) & 1;
+  const bool has_osxsave = (info[2] >> 27) & 1;
+  // AVX2 можно использовать, только если ОС сохраняет ymm-регистры
+  bool has_avx2 = false;
+  if (max_leaf >= 7 && has_osxsave && (_xgetbv(0) & 6) == 6) {
+    __cpuidex(info, 7, 0);
+    has_avx2 = (info[1] >> 5) & 1;
+  }
+  #else
+  __builtin_cpu_init();
+  const bool has_sse2 = __builtin_cpu_supports("sse2");
+  const bool has_avx2 = __builtin_cpu_supports("avx2");
+  #endif
+  if (has_avx2) {
+    return SimdLevel::kAvx2;
+  }
+  if (has_sse2) {
+    return SimdLevel::kSse2;
+  }
+#endif
+  return SimdLevel::kScalar;
+}
+
+inline SimdLevel GetSimdLevel() {
+  static const SimdLevel level = DetectSimdLevel();
+  return level;
+}
+
+namespace char_scan_impl {
+
+inline int CountTrailingZeros(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+template <typename OnMatch>
+void ForEachCharScalar(std::string_view text, size_t from, char c, OnMatch& on_match) {
+  for (size_t pos = from; pos < text.size(); ++pos) {
+    if (text[pos] == c) {
+      on_match(pos);
+    }
+  }
+}
+
+template <typename OnMatch>
+void ForEachMaskBit(uint32_t mask, size_t base, OnMatch& on_match) {
+  while (mask != 0) {
+    on_match(base + CountTrailingZeros(mask));
+    mask &= mask - 1;
+  }
+}
+
+#if defined(CHAR_SCAN_X86)
+
+template <typename OnMatch>
+CHAR_SCAN_TARGET("sse2")
+void ForEachCharSse2(std::string_view text, char c, OnMatch& on_match) {
+  const __m128i pattern = _mm_set1_epi8(c);
+  size_t pos = 0;
+  for (; pos + 16 <= text.size(); pos += 16) {
+    const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos));
+    const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern)));
+    ForEachMaskBit(mask, pos, on_match);
+  }
+  ForEachCharScalar(text, pos, c, on_match);
+}
+
+template <typename OnMatch>
+CHAR_SCAN_TARGET("avx2")
+void ForEachCharAvx2(std::string_view text, char c, OnMatch& on_match) {
+  const __m256i pattern = _mm256_set1_epi8(c);
+  size_t pos = 0;
+  for (; pos + 32 <= text.size(); pos += 32) {
+    const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + pos));
+    const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, pattern)));
+    ForEachMaskBit(mask, pos, on_match);
+  }
+  ForEachCharScalar(text, pos, c, on_match);
+}
+
+#endif
+
+}  // namespace char_scan_impl
+
+// вызывает on_match(pos) для каждой позиции символа c в text по возрастанию
+template <typename OnMatch>
+void ForEachChar(std::string_view text, char c, OnMatch on_match, SimdLevel level = GetSimdLevel()) {
+#if defined(CHAR_SCAN_X86)
+  switch (level) {
+  case SimdLevel::kAvx2:
+    char_scan_impl::ForEachCharAvx2(text, c, on_match);
+    return;
+  case SimdLevel::kSse2:
+    char_scan_impl::ForEachCharSse2(text, c, on_match);
+    return;
+  case SimdLevel::kScalar:
+    break;
+  }
+#endif
+  (void)level;
+  char_scan_impl::ForEachCharScalar(text, 0, c, on_match);
+}
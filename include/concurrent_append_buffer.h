@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Ограниченный буфер, в который много потоков дописывают элементы без блокировок.
+// Поток резервирует сразу блок из block_size ячеек (один fetch_add на блок) и заполняет
+// его сам; сколько ячеек блока занято, хранится рядом в отдельной кэш-линии.
+// После того как все писатели закончили, Finalize() сдвигает недописанные хвосты
+// блоков, и буфер читается как обычный массив, пока Clear() не начнёт новый раунд.
+//
+// Текущий блок потока хранится в thread_local, поэтому поток должен писать в один
+// буфер за раз: при переключении на другой буфер хвост блока остаётся пустым.
+// В ёмкость входят такие хвосты – не больше block_size на поток-писатель за раунд.
+template <typename T>
+class ConcurrentAppendBuffer {
+public:
+  static constexpr size_t kDefaultBlockSize = 256;
+
+  // capacity – сколько элементов поместится, если писателей не больше writer_count
+  explicit ConcurrentAppendBuffer(size_t capacity,
+                                  size_t writer_count = std::thread::hardware_concurrency() + 1,
+                                  size_t block_size = kDefaultBlockSize)
+    : block_size_(std::max<size_t>(block_size, 1))
+    , block_count_((capacity + block_size_ - 1) / block_size_ + std::max<size_t>(writer_count, 1))
+    , values_(block_count_ * block_size_)
+    , block_fill_(block_count_)
+    , generation_(NextGeneration())
+  {
+  }
+
+  ConcurrentAppendBuffer(const ConcurrentAppendBuffer&) = delete;
+  ConcurrentAppendBuffer& operator=(const ConcurrentAppendBuffer&) = delete;
+
+  void push_back(const T& value) {
+    LocalBlock& local = GetLocalBlock();
+    if (local.used == block_size_) {
+      local.block = ReserveBlocks(1);
+      local.used = 0;
+    }
+    values_[local.block * block_size_ + local.used] = value;
+    block_fill_[local.block].count = ++local.used;
+  }
+
+  // дописывает [first, last) подряд: сначала в остаток текущего блока,
+  // остальное – в несколько блоков, зарезервированных одним fetch_add
+  template <typename Iterator>
+  void Append(Iterator first, Iterator last) {
+    size_t count = std::distance(first, last);
+    if (count == 0) {
+      return;
+    }
+    LocalBlock& local = GetLocalBlock();
+    const size_t head = std::min(count, block_size_ - local.used);
+    if (head > 0) {
+      std::copy_n(first, head, values_.begin() + local.block * block_size_ + local.used);
+      std::advance(first, head);
+      count -= head;
+      local.used += head;
+      block_fill_[local.block].count = local.used;
+    }
+    if (count == 0) {
+      return;
+    }
+    const size_t reserved = (count + block_size_ - 1) / block_size_;
+    const size_t block = ReserveBlocks(reserved);
+    std::copy_n(first, count, values_.begin() + block * block_size_);
+    for (size_t i = 0; i + 1 < reserved; ++i) {
+      block_fill_[block + i].count = block_size_;
+    }
+    local.block = block + reserved - 1;
+    local.used = count - (reserved - 1) * block_size_;
+    block_fill_[local.block].count = local.used;
+  }
+
+  // Склеивает занятые части блоков в начало буфера. Вызывается, когда писатели закончили;
+  // после этого буфер только читается
+  void Finalize() {
+    const size_t used_blocks = std::min(next_block_.load(std::memory_order_relaxed), block_count_);
+    size_t size = 0;
+    for (size_t block = 0; block < used_blocks; ++block) {
+      const size_t count = block_fill_[block].count;
+      const auto begin = values_.begin() + block * block_size_;
+      if (size != block * block_size_) {
+        std::move(begin, begin + count, values_.begin() + size);
+      }
+      size += count;
+    }
+    size_ = size;
+    generation_ = NextGeneration();
+  }
+
+  // начинает новый раунд записи
+  void Clear() {
+    const size_t used_blocks = std::min(next_block_.load(std::memory_order_relaxed), block_count_);
+    for (size_t block = 0; block < used_blocks; ++block) {
+      block_fill_[block].count = 0;
+    }
+    next_block_.store(0, std::memory_order_relaxed);
+    size_ = 0;
+    generation_ = NextGeneration();
+  }
+
+  // после Finalize()
+  const T* begin() const {
+    return values_.data();
+  }
+
+  const T* end() const {
+    return values_.data() + size_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  const T& operator[](size_t index) const {
+    return values_[index];
+  }
+
+private:
+  struct alignas(64) BlockFill {
+    size_t count = 0;
+  };
+
+  // текущий блок потока; поколение отличает блок прошлого раунда
+  // или уже уничтоженного буфера по тому же адресу
+  struct LocalBlock {
+    const ConcurrentAppendBuffer* owner = nullptr;
+    uint64_t generation = 0;
+    size_t block = 0;
+    size_t used = 0;
+  };
+
+  static uint64_t NextGeneration() {
+    static std::atomic<uint64_t> next_generation = 0;
+    return ++next_generation;
+  }
+
+  LocalBlock& GetLocalBlock() {
+    thread_local LocalBlock local;
+    if (local.owner != this || local.generation != generation_) {
+      local = {this, generation_, 0, block_size_};
+    }
+    return local;
+  }
+
+  size_t ReserveBlocks(size_t count) {
+    const size_t block = next_block_.fetch_add(count, std::memory_order_relaxed);
+    if (block + count > block_count_) {
+      throw std::length_error("ConcurrentAppendBuffer is full");
+    }
+    return block;
+  }
+
+  const size_t block_size_;
+  const size_t block_count_;
+  std::vector<T> values_;
+  std::vector<BlockFill> block_fill_;
+  uint64_t generation_;
+  size_t size_ = 0;
+  alignas(64) std::atomic<size_t> next_block_ = 0;
+};
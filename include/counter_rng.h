@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(_MSC_VER) && !defined(__clang__) && (defined(_M_X64) || defined(_M_ARM64))
+  #define COUNTER_RNG_UMULH
+  #include <intrin.h>
+#endif
+
+// Генератор случайных чисел со счётчиком (counter-based): i-е число зависит
+// только от (seed, i), поэтому каждый поток может начать с любого места
+// последовательности, не прокручивая предыдущие числа.
+// Перемешивание – финализатор SplitMix64.
+class CounterRng {
+public:
+  explicit CounterRng(uint64_t seed, uint64_t counter = 0)
+    : key_(Mix(seed))
+    , counter_(counter)
+  {
+  }
+
+  static uint64_t Mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  }
+
+  // число с номером counter, состояние генератора не меняется
+  uint64_t At(uint64_t counter) const {
+    return Mix(key_ ^ Mix(counter));
+  }
+
+  uint64_t operator()() {
+    return At(counter_++);
+  }
+
+  // равномерно распределённое число из [0, bound)
+  uint32_t Below(uint32_t bound) {
+    return static_cast<uint32_t>(((*this)() >> 32) * bound >> 32);
+  }
+
+  // то же для 64-битной границы: старшая половина 128-битного произведения
+  uint64_t Below64(uint64_t bound) {
+    return MulHigh((*this)(), bound);
+  }
+
+  // равномерно распределённое число из [from, to]
+  int Uniform(int from, int to) {
+    return from + static_cast<int>(Below(static_cast<uint32_t>(to - from) + 1));
+  }
+
+  uint64_t GetCounter() const {
+    return counter_;
+  }
+
+private:
+  static uint64_t MulHigh(uint64_t lhs, uint64_t rhs) {
+#if defined(COUNTER_RNG_UMULH)
+    return __umulh(lhs, rhs);
+#elif defined(__SIZEOF_INT128__)
+    return static_cast<uint64_t>(static_cast<unsigned __int128>(lhs) * rhs >> 64);
+#else
+    // 32-битные платформы: произведение по 32-битным половинам
+    const uint64_t lhs_low = lhs & 0xffffffffu;
+    const uint64_t lhs_high = lhs >> 32;
+    const uint64_t rhs_low = rhs & 0xffffffffu;
+    const uint64_t rhs_high = rhs >> 32;
+    const uint64_t low_low = lhs_low * rhs_low;
+    const uint64_t low_high = lhs_low * rhs_high;
+    const uint64_t high_low = lhs_high * rhs_low;
+    const uint64_t middle = (low_low >> 32) + (low_high & 0xffffffffu) + (high_low & 0xffffffffu);
+    return lhs_high * rhs_high + (low_high >> 32) + (high_low >> 32) + (middle >> 32);
+#endif
+  }
+
+  uint64_t key_;
+  uint64_t counter_;
+};
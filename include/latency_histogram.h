@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+// Гистограмма длительностей в наносекундах в духе HdrHistogram: значения меньше 32
+// хранятся точно, дальше каждая степень двойки делится на 16 корзин одинаковой ширины,
+// так что относительная погрешность не больше 1/16 при постоянном размере.
+class LatencyHistogram {
+public:
+  static constexpr int kSubBucketBits = 5;
+  static constexpr int kHalfSubBucketCount = 1 << (kSubBucketBits - 1);
+  static constexpr int kBucketCount = (64 - kSubBucketBits + 2) * kHalfSubBucketCount;
+
+  static int GetBucket(uint64_t value) {
+    const int shift = std::max(0, HighestBit(value) - kSubBucketBits + 1);
+    return shift * kHalfSubBucketCount + static_cast<int>(value >> shift);
+  }
+
+  // наибольшее значение, попадающее в корзину
+  static uint64_t GetBucketUpperBound(int bucket) {
+    if (bucket < 2 * kHalfSubBucketCount) {
+      return bucket;
+    }
+    const int shift = bucket / kHalfSubBucketCount - 1;
+    const uint64_t top = bucket - shift * kHalfSubBucketCount;
+    return ((top + 1) << shift) - 1;
+  }
+
+  void Add(int bucket, uint64_t count) {
+    counts_[bucket] += count;
+    total_count_ += count;
+  }
+
+  void Record(uint64_t value) {
+    Add(GetBucket(value), 1);
+    max_ = std::max(max_, value);
+  }
+
+  void UpdateMax(uint64_t value) {
+    max_ = std::max(max_, value);
+  }
+
+  void Merge(const LatencyHistogram& other) {
+    for (int bucket = 0; bucket < kBucketCount; ++bucket) {
+      counts_[bucket] += other.counts_[bucket];
+    }
+    total_count_ += other.total_count_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  uint64_t GetCount() const {
+    return total_count_;
+  }
+
+  uint64_t GetMax() const {
+    return max_;
+  }
+
+  // значение, не меньше которого доля quantile всех записей (с точностью до корзины)
+  uint64_t GetValueAtQuantile(double quantile) const {
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(quantile * total_count_ + 0.5));
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < kBucketCount; ++bucket) {
+      seen += counts_[bucket];
+      if (seen >= rank) {
+        return std::min(GetBucketUpperBound(bucket), max_);
+      }
+    }
+    return max_;
+  }
+
+private:
+  static int HighestBit(uint64_t value) {
+    int bit = -1;
+    while (value != 0) {
+      value >>= 1;
+      ++bit;
+    }
+    return bit;
+  }
+
+  std::array<uint64_t, kBucketCount> counts_ = {};
+  uint64_t total_count_ = 0;
+  uint64_t max_ = 0;
+};
+
+// Запись длительностей из многих потоков без блокировок: у каждого потока свой шард
+// гистограммы (пока потоков не больше kShardCount, шарды ни с кем не делятся),
+// в конце прогона шарды сливаются в одну LatencyHistogram.
+class LatencyRecorder {
+public:
+  static constexpr size_t kShardCount = 64;
+
+  LatencyRecorder()
+    : shards_(std::make_unique<Shard[]>(kShardCount))
+  {
+  }
+
+  void Record(std::chrono::nanoseconds duration) {
+    const uint64_t value = std::max<int64_t>(0, duration.count());
+    Shard& shard = shards_[GetThreadShard()];
+    shard.counts[LatencyHistogram::GetBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = shard.max.load(std::memory_order_relaxed);
+    while (value > max && !shard.max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+  }
+
+  void Reset() {
+    for (size_t i = 0; i < kShardCount; ++i) {
+      for (auto& count : shards_[i].counts) {
+        count.store(0, std::memory_order_relaxed);
+      }
+      shards_[i].max.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  LatencyHistogram Collect() const {
+    LatencyHistogram histogram;
+    for (size_t i = 0; i < kShardCount; ++i) {
+      for (int bucket = 0; bucket < LatencyHistogram::kBucketCount; ++bucket) {
+        const uint64_t count = shards_[i].counts[bucket].load(std::memory_order_relaxed);
+        if (count > 0) {
+          histogram.Add(bucket, count);
+        }
+      }
+      histogram.UpdateMax(shards_[i].max.load(std::memory_order_relaxed));
+    }
+    return histogram;
+  }
+
+private:
+  struct alignas(64) Shard {
+    std::array<std::atomic<uint64_t>, LatencyHistogram::kBucketCount> counts = {};
+    std::atomic<uint64_t> max = 0;
+  };
+
+  static size_t GetThreadShard() {
+    static std::atomic<size_t> next_shard = 0;
+    thread_local const size_t shard = next_shard++ % kShardCount;
+    return shard;
+  }
+
+  std::unique_ptr<Shard[]> shards_;
+};
+
+inline std::string FormatNanoseconds(double nanoseconds) {
+  static constexpr std::pair<double, const char*> kUnits[] = {
+    {1e9, "s"}, {1e6, "ms"}, {1e3, "us"},
+  };
+  std::ostringstream os;
+  os << std::setprecision(3);
+  for (const auto& [scale, unit] : kUnits) {
+    if (nanoseconds >= scale) {
+      os << nanoseconds / scale << " " << unit;
+      return os.str();
+    }
+  }
+  os << nanoseconds << " ns";
+  return os.str();
+}
+
+// Аналог LogDuration для гистограмм: при создании обнуляет recorder,
+// при уничтожении печатает перцентили и пропускную способность прогона.
+// Если recorder == nullptr, ничего не делает.
+class LatencyReport {
+public:
+  LatencyReport(LatencyRecorder* recorder, std::string_view label)
+    : recorder_(recorder)
+    , label_(label)
+    , start_(std::chrono::steady_clock::now())
+  {
+    if (recorder_) {
+      recorder_->Reset();
+    }
+  }
+
+  ~LatencyReport() {
+    if (!recorder_) {
+      return;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+    const LatencyHistogram histogram = recorder_->Collect();
+    std::ostringstream os;
+    os << label_ << " latency: " << histogram.GetCount() << " tests, "
+       << std::fixed << std::setprecision(0) << histogram.GetCount() / elapsed.count() << " tests/s"
+       << std::defaultfloat;
+    static constexpr std::pair<const char*, double> kQuantiles[] = {
+      {"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}, {"p999", 0.999},
+    };
+    for (const auto& [name, quantile] : kQuantiles) {
+      os << ", " << name << " = " << FormatNanoseconds(histogram.GetValueAtQuantile(quantile));
+    }
+    os << ", max = " << FormatNanoseconds(histogram.GetMax()) << std::endl;
+    std::cerr << os.str();
+  }
+
+private:
+  LatencyRecorder* recorder_;
+  std::string label_;
+  std::chrono::steady_clock::time_point start_;
+};
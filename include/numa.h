@@ -0,0 +1,512 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "thread_pool.h"
+
+#ifdef _WIN32
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#else
+  #include <pthread.h>
+  #include <sched.h>
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+// Размещение памяти и потоков на машинах с несколькими NUMA-узлами, без libnuma.
+// Страница достаётся узлу того потока, который первым её коснулся (first touch),
+// поэтому большой буфер выделяется нетронутыми страницами, и их сразу касаются потоки,
+// закреплённые за узлами: через одну (interleave – обращения к памяти делятся между
+// узлами поровну) или кусками подряд (partition – i-я часть буфера на i-м узле).
+// Топология читается из /sys (в Windows – GetNumaNodeProcessorMask, только первая
+// группа процессоров). Если узел один или топология неизвестна, всё сводится
+// к обычному выделению памяти и потоки не закрепляются.
+
+enum class NumaPlacement {
+  kDefault,     // страницы достаются узлу первого записавшего потока
+  kInterleave,
+  kPartition,
+};
+
+inline NumaPlacement ParseNumaPlacement(std::string_view name) {
+  if (name == "off") {
+    return NumaPlacement::kDefault;
+  }
+  if (name == "interleave") {
+    return NumaPlacement::kInterleave;
+  }
+  if (name == "partition") {
+    return NumaPlacement::kPartition;
+  }
+  throw std::invalid_argument("unknown NUMA placement " + std::string(name));
+}
+
+struct NumaNode {
+  int id;
+  std::vector<int> cpus;
+};
+
+namespace numa_impl {
+
+// список вида "0-3,8-11" из /sys
+inline std::vector<int> ParseList(const std::string& text) {
+  std::vector<int> values;
+  std::istringstream input(text);
+  std::string range;
+  while (std::getline(input, range, ',')) {
+    if (range.empty()) {
+      continue;
+    }
+    const size_t dash = range.find('-');
+    const int first = std::stoi(range.substr(0, dash));
+    const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int value = first; value <= last; ++value) {
+      values.push_back(value);
+    }
+  }
+  return values;
+}
+
+inline std::string ReadLine(const std::string& path) {
+  std::ifstream input(path);
+  std::string line;
+  std::getline(input, line);
+  return line;
+}
+
+}  // namespace numa_impl
+
+// Узлы, на которых этому процессу разрешено работать; узлы без процессоров пропускаются
+class NumaTopology {
+public:
+  static const NumaTopology& Get() {
+    static const NumaTopology topology;
+    return topology;
+  }
+
+  const std::vector<NumaNode>& GetNodes() const {
+    return nodes_;
+  }
+
+  size_t GetNodeCount() const {
+    return nodes_.size();
+  }
+
+  bool IsNuma() const {
+    return nodes_.size() > 1;
+  }
+
+  // индекс в GetNodes() узла с данным номером ОС или GetNodeCount(), если такого нет
+  size_t FindNode(int id) const {
+    for (size_t index = 0; index < nodes_.size(); ++index) {
+      if (nodes_[index].id == id) {
+        return index;
+      }
+    }
+    return nodes_.size();
+  }
+
+private:
+  NumaTopology() {
+    try {
+      Detect();
+    } catch (const std::exception&) {
+      nodes_.clear();
+    }
+    if (nodes_.empty()) {
+      NumaNode node{0, {}};
+      for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+        node.cpus.push_back(cpu);
+      }
+      nodes_.push_back(std::move(node));
+    }
+  }
+
+  void Detect() {
+#ifdef _WIN32
+    ULONG highest_node = 0;
+    if (!GetNumaHighestNodeNumber(&highest_node)) {
+      return;
+    }
+    for (ULONG id = 0; id <= highest_node; ++id) {
+      ULONGLONG mask = 0;
+      if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(id), &mask)) {
+        continue;
+      }
+      NumaNode node{static_cast<int>(id), {}};
+      // маска потока в PinThreadToNode – DWORD_PTR, на 32-битной сборке в ней 32 процессора
+      constexpr int kMaxCpuCount = static_cast<int>(std::min(sizeof(mask), sizeof(DWORD_PTR)) * CHAR_BIT);
+      for (int cpu = 0; cpu < kMaxCpuCount; ++cpu) {
+        if ((mask >> cpu) & 1) {
+          node.cpus.push_back(cpu);
+        }
+      }
+      if (!node.cpus.empty()) {
+        nodes_.push_back(std::move(node));
+      }
+    }
+#else
+    const std::string online = numa_impl::ReadLine("/sys/devices/system/node/online");
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    const bool has_allowed = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    for (const int id : numa_impl::ParseList(online)) {
+      const std::string cpus = numa_impl::ReadLine(
+        "/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+      NumaNode node{id, {}};
+      for (const int cpu : numa_impl::ParseList(cpus)) {
+        if (!has_allowed || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) {
+          node.cpus.push_back(cpu);
+        }
+      }
+      if (!node.cpus.empty()) {
+        nodes_.push_back(std::move(node));
+      }
+    }
+#endif
+  }
+
+  std::vector<NumaNode> nodes_;
+};
+
+// закрепляет поток за процессорами узла с индексом node; false, если ОС не позволила
+inline bool PinThreadToNode(std::thread::native_handle_type thread, size_t node) {
+  const std::vector<int>& cpus = NumaTopology::Get().GetNodes().at(node).cpus;
+#ifdef _WIN32
+  DWORD_PTR mask = 0;
+  for (const int cpu : cpus) {
+    mask |= DWORD_PTR{1} << cpu;
+  }
+  return SetThreadAffinityMask(static_cast<HANDLE>(thread), mask) != 0;
+#else
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+#endif
+}
+
+inline bool PinCurrentThreadToNode(size_t node) {
+#ifdef _WIN32
+  return PinThreadToNode(GetCurrentThread(), node);
+#else
+  return PinThreadToNode(pthread_self(), node);
+#endif
+}
+
+namespace numa_impl {
+
+// пул, закреплённый PinThreadPool, и индекс узла для каждого его потока
+// (GetNodeCount(), если поток закрепить не удалось)
+struct PinnedPool {
+  ThreadPool* pool = nullptr;
+  std::vector<size_t> nodes;
+};
+
+inline PinnedPool& GetPinnedPool() {
+  static PinnedPool pinned;
+  return pinned;
+}
+
+}  // namespace numa_impl
+
+// Закрепляет потоки пула за узлами поровну и по порядку: первые – за первым узлом и т.д.
+// Возвращает, сколько потоков закреплено за каждым узлом; на машине с одним узлом
+// ничего не меняет и возвращает пустой вектор.
+// Вызывается один раз при старте: дальше NumaAllocator касается страниц потоками этого пула
+inline std::vector<size_t> PinThreadPool(ThreadPool& pool) {
+  const NumaTopology& topology = NumaTopology::Get();
+  if (!topology.IsNuma()) {
+    return {};
+  }
+  std::vector<size_t> thread_counts(topology.GetNodeCount());
+  const size_t thread_count = pool.GetThreadCount();
+  std::vector<size_t> nodes(thread_count, topology.GetNodeCount());
+  for (size_t index = 0; index < thread_count; ++index) {
+    const size_t node = index * topology.GetNodeCount() / thread_count;
+    if (PinThreadToNode(pool.GetNativeHandle(index), node)) {
+      nodes[index] = node;
+      ++thread_counts[node];
+    }
+  }
+  numa_impl::GetPinnedPool() = {&pool, std::move(nodes)};
+  return thread_counts;
+}
+
+// размещение по умолчанию для NumaAllocator, общее на всю программу.
+// Оно фиксировано на весь процесс: SetNumaPlacement вызывается один раз при старте,
+// до создания первого NumaVector, и дальше не меняется
+inline std::atomic<NumaPlacement>& DefaultNumaPlacement() {
+  static std::atomic<NumaPlacement> placement = NumaPlacement::kDefault;
+  return placement;
+}
+
+inline NumaPlacement GetNumaPlacement() {
+  return DefaultNumaPlacement().load(std::memory_order_relaxed);
+}
+
+inline void SetNumaPlacement(NumaPlacement placement) {
+  DefaultNumaPlacement().store(placement, std::memory_order_relaxed);
+}
+
+namespace numa_impl {
+
+constexpr size_t kPageSize = 4096;
+// меньшие буферы выделяются обычным new: размещать их по узлам дороже, чем обращаться издалека
+constexpr size_t kMinPlacedSize = size_t{1} << 20;
+// страницы узла раздаются потокам кусками по столько
+constexpr size_t kPagesPerChunk = 256;
+// сколько раз раздать задачи пулу, прежде чем дотронуться до оставшихся узлов своими потоками
+constexpr size_t kPoolTouchRounds = 2;
+
+inline bool ShouldPlace(NumaPlacement placement, size_t size) {
+  return placement != NumaPlacement::kDefault && size >= kMinPlacedSize && NumaTopology::Get().IsNuma();
+}
+
+// нетронутые страницы прямо у ОС, чтобы первое касание было нашим
+inline void* AllocatePages(size_t size) {
+#ifdef _WIN32
+  return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return data == MAP_FAILED ? nullptr : data;
+#endif
+}
+
+inline void FreePages(void* data, size_t size) {
+#ifdef _WIN32
+  (void)size;
+  VirtualFree(data, 0, MEM_RELEASE);
+#else
+  munmap(data, size);
+#endif
+}
+
+// Касается страниц [data, data + size) потоками, закреплёнными за узлами:
+// узлу node достаются страницы с номерами node, node + n, ... (interleave)
+// или node-я из n частей подряд (partition). Страницы узла раздаются кусками, поэтому
+// их делят все потоки этого узла. Касаются потоки пула, закреплённого PinThreadPool;
+// узлы, до которых его потоки не добрались, – временные потоки, закреплённые здесь же
+inline void TouchPages(char* data, size_t size, NumaPlacement placement) {
+  const NumaTopology& topology = NumaTopology::Get();
+  const size_t node_count = topology.GetNodeCount();
+  const size_t page_count = (size + kPageSize - 1) / kPageSize;
+  const bool partition = placement == NumaPlacement::kPartition;
+  const size_t step = partition ? 1 : node_count;
+  auto get_first_page = [=](size_t node) {
+    return partition ? node * page_count / node_count : node;
+  };
+  auto get_node_pages = [=](size_t node) {
+    const size_t first = get_first_page(node);
+    const size_t last = partition ? (node + 1) * page_count / node_count : page_count;
+    return first < last ? (last - first + step - 1) / step : 0;
+  };
+  std::vector<std::atomic<size_t>> next_chunks(node_count);
+  auto touch_node = [&](size_t node) {
+    const size_t first = get_first_page(node);
+    const size_t node_pages = get_node_pages(node);
+    for (size_t chunk = next_chunks[node]++; chunk * kPagesPerChunk < node_pages; chunk = next_chunks[node]++) {
+      const size_t end = std::min(node_pages, (chunk + 1) * kPagesPerChunk);
+      for (size_t index = chunk * kPagesPerChunk; index < end; ++index) {
+        static_cast<volatile char*>(data)[(first + index * step) * kPageSize] = 0;
+      }
+    }
+  };
+  auto is_claimed = [&](size_t node) {
+    return next_chunks[node] * kPagesPerChunk >= get_node_pages(node);
+  };
+
+  // каждая задача касается страниц узла того потока, который её выполнил;
+  // поток пула ждёт, выполняя задачи, остальные просто ждут, чтобы задачи не ушли мимо пула
+  const PinnedPool& pinned = GetPinnedPool();
+  for (size_t round = 0; pinned.pool != nullptr && round < kPoolTouchRounds; ++round) {
+    bool has_unclaimed = false;
+    for (size_t node = 0; node < node_count; ++node) {
+      has_unclaimed |= !is_claimed(node);
+    }
+    if (!has_unclaimed) {
+      break;
+    }
+    ThreadPool& pool = *pinned.pool;
+    std::vector<std::future<void>> tasks;
+    tasks.reserve(pool.GetThreadCount());
+    for (size_t i = 0; i < pool.GetThreadCount(); ++i) {
+      tasks.push_back(pool.Submit([&] {
+        const size_t index = pool.GetCurrentIndex();
+        if (index < pinned.nodes.size() && pinned.nodes[index] < node_count) {
+          touch_node(pinned.nodes[index]);
+        }
+      }));
+    }
+    const bool is_pool_thread = pool.GetCurrentIndex() < pool.GetThreadCount();
+    for (std::future<void>& task : tasks) {
+      if (is_pool_thread) {
+        pool.Wait(task);
+      } else {
+        task.wait();
+      }
+    }
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t node = 0; node < node_count; ++node) {
+    if (is_claimed(node)) {
+      continue;
+    }
+    const size_t thread_count = std::clamp<size_t>(
+      get_node_pages(node) / kPagesPerChunk, 1, topology.GetNodes()[node].cpus.size());
+    for (size_t thread = 0; thread < thread_count; ++thread) {
+      threads.emplace_back([&touch_node, node] {
+        PinCurrentThreadToNode(node);
+        touch_node(node);
+      });
+    }
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace numa_impl
+
+// Аллокатор, размещающий большие буферы по узлам согласно placement
+// (по умолчанию – GetNumaPlacement() на момент создания аллокатора).
+// Контейнер потом обнуляет память в своём потоке, но страницы остаются на своих узлах.
+// Аллокатор хранит placement, поэтому при swap и перемещающем присваивании он
+// переезжает вместе с буфером – иначе буфер освобождался бы чужим способом
+template <typename T>
+class NumaAllocator {
+public:
+  using value_type = T;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  NumaAllocator()
+    : placement_(GetNumaPlacement())
+  {
+  }
+
+  explicit NumaAllocator(NumaPlacement placement)
+    : placement_(placement)
+  {
+  }
+
+  template <typename U>
+  NumaAllocator(const NumaAllocator<U>& other)
+    : placement_(other.GetPlacement())
+  {
+  }
+
+  T* allocate(size_t count) {
+    const size_t size = count * sizeof(T);
+    if (!numa_impl::ShouldPlace(placement_, size)) {
+      return static_cast<T*>(::operator new(size));
+    }
+    void* data = numa_impl::AllocatePages(size);
+    if (data == nullptr) {
+      throw std::bad_alloc();
+    }
+    numa_impl::TouchPages(static_cast<char*>(data), size, placement_);
+    return static_cast<T*>(data);
+  }
+
+  void deallocate(T* data, size_t count) {
+    const size_t size = count * sizeof(T);
+    if (!numa_impl::ShouldPlace(placement_, size)) {
+      ::operator delete(data);
+    } else {
+      numa_impl::FreePages(data, size);
+    }
+  }
+
+  NumaPlacement GetPlacement() const {
+    return placement_;
+  }
+
+  template <typename U>
+  bool operator==(const NumaAllocator<U>& other) const {
+    return placement_ == other.GetPlacement();
+  }
+
+  template <typename U>
+  bool operator!=(const NumaAllocator<U>& other) const {
+    return placement_ != other.GetPlacement();
+  }
+
+private:
+  NumaPlacement placement_;
+};
+
+template <typename T>
+using NumaVector = std::vector<T, NumaAllocator<T>>;
+
+// Сколько страниц [data, data + size) лежит на каждом узле (по индексам GetNodes()).
+// Проверяется не больше kMaxSampledPages страниц через равные промежутки; ещё не
+// тронутые страницы не считаются. Пустой вектор, если ОС не отвечает (Windows,
+// ядро без move_pages, запрет в контейнере)
+inline std::vector<size_t> CountPagesByNode(const void* data, size_t size) {
+  constexpr size_t kMaxSampledPages = 1 << 16;
+  const NumaTopology& topology = NumaTopology::Get();
+  std::vector<size_t> counts(topology.GetNodeCount());
+#if !defined(_WIN32) && defined(SYS_move_pages)
+  const size_t page_count = (size + numa_impl::kPageSize - 1) / numa_impl::kPageSize;
+  const size_t sample_count = std::min(page_count, kMaxSampledPages);
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(data) / numa_impl::kPageSize * numa_impl::kPageSize;
+  std::vector<void*> pages(sample_count);
+  for (size_t sample = 0; sample < sample_count; ++sample) {
+    pages[sample] = reinterpret_cast<void*>(begin + sample * page_count / sample_count * numa_impl::kPageSize);
+  }
+  // без целевых узлов move_pages ничего не переносит, а только сообщает узел каждой страницы
+  std::vector<int> status(sample_count);
+  if (syscall(SYS_move_pages, 0, sample_count, pages.data(), nullptr, status.data(), 0) != 0) {
+    return {};
+  }
+  for (const int id : status) {
+    const size_t node = id >= 0 ? topology.FindNode(id) : counts.size();
+    if (node < counts.size()) {
+      ++counts[node];
+    }
+  }
+  return counts;
+#else
+  (void)data;
+  (void)size;
+  return {};
+#endif
+}
+
+// доли по узлам: "node 0: 50.1%, node 1: 49.9%"
+inline std::string FormatNodeShares(const std::vector<size_t>& counts) {
+  size_t total = 0;
+  for (const size_t count : counts) {
+    total += count;
+  }
+  std::ostringstream os;
+  os << std::fixed << std::setprecision(1);
+  for (size_t node = 0; node < counts.size(); ++node) {
+    os << (node > 0 ? ", " : "") << "node " << NumaTopology::Get().GetNodes()[node].id << ": "
+       << (total > 0 ? 100.0 * counts[node] / total : 0.0) << "%";
+  }
+  return os.str();
+}
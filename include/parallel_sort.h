@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.h"
+
+// Параллельная сортировка на пуле потоков. Целые числа – поразрядной LSD-сортировкой
+// по байтам, остальные типы – слиянием. Массив режется на блоки фиксированного размера,
+// а не по числу потоков, и обе сортировки устойчивы, поэтому результат не зависит
+// от того, сколько потоков в пуле.
+
+namespace parallel_sort_impl {
+
+constexpr size_t kBlockSize = 1 << 16;
+constexpr int kRadixBits = 8;
+constexpr size_t kRadixSize = 1 << kRadixBits;
+
+template <typename T>
+using UnsignedOf = std::make_unsigned_t<T>;
+
+// ключ, упорядоченный как T: у знаковых переворачиваем старший бит
+template <typename T>
+UnsignedOf<T> RadixKey(T value) {
+  auto key = static_cast<UnsignedOf<T>>(value);
+  if constexpr (std::is_signed_v<T>) {
+    key ^= UnsignedOf<T>{1} << (std::numeric_limits<UnsignedOf<T>>::digits - 1);
+  }
+  return key;
+}
+
+}  // namespace parallel_sort_impl
+
+template <typename T>
+void ParallelRadixSort(std::vector<T>& values, ThreadPool& pool = ThreadPool::Shared()) {
+  static_assert(std::is_integral_v<T>, "ParallelRadixSort sorts integers only");
+  using namespace parallel_sort_impl;
+  using Counts = std::array<size_t, kRadixSize>;
+
+  const size_t size = values.size();
+  const size_t block_count = (size + kBlockSize - 1) / kBlockSize;
+  std::vector<T> buffer(size);
+  std::vector<Counts> counts(block_count);
+  T* from = values.data();
+  T* to = buffer.data();
+
+  for (int shift = 0; shift < std::numeric_limits<UnsignedOf<T>>::digits; shift += kRadixBits) {
+    auto digit = [shift](T value) {
+      return static_cast<size_t>((RadixKey(value) >> shift) & (kRadixSize - 1));
+    };
+
+    pool.ParallelFor(size_t{0}, block_count, [&](size_t block) {
+      Counts& block_counts = counts[block];
+      block_counts.fill(0);
+      const size_t end = std::min(size, (block + 1) * kBlockSize);
+      for (size_t i = block * kBlockSize; i < end; ++i) {
+        ++block_counts[digit(from[i])];
+      }
+    });
+
+    // позиция, с которой блок пишет свои элементы с данной цифрой:
+    // сначала все блоки для цифры 0, затем для 1 и т.д.
+    size_t offset = 0;
+    bool single_digit = false;
+    for (size_t d = 0; d < kRadixSize; ++d) {
+      size_t digit_count = 0;
+      for (Counts& block_counts : counts) {
+        const size_t count = block_counts[d];
+        block_counts[d] = offset;
+        offset += count;
+        digit_count += count;
+      }
+      single_digit = single_digit || digit_count == size;
+    }
+    // все элементы с одной цифрой – проход ничего не переставит
+    if (single_digit) {
+      continue;
+    }
+
+    pool.ParallelFor(size_t{0}, block_count, [&](size_t block) {
+      Counts& positions = counts[block];
+      const size_t end = std::min(size, (block + 1) * kBlockSize);
+      for (size_t i = block * kBlockSize; i < end; ++i) {
+        to[positions[digit(from[i])]++] = from[i];
+      }
+    });
+    std::swap(from, to);
+  }
+
+  if (from != values.data()) {
+    values.swap(buffer);
+  }
+}
+
+// Устойчивая сортировка слиянием: блоки сортируются std::stable_sort,
+// затем соседние отсортированные куски попарно сливаются, пока кусок не один.
+// Каждое слияние тоже параллельное: длинный кусок режется на части,
+// границы во втором находятся бинарным поиском.
+template <typename T, typename Compare = std::less<>>
+void ParallelMergeSort(std::vector<T>& values, Compare compare = {}, ThreadPool& pool = ThreadPool::Shared()) {
+  using namespace parallel_sort_impl;
+
+  const size_t size = values.size();
+  pool.ParallelForChunks(size_t{0}, size, [&](size_t begin, size_t end) {
+    std::stable_sort(values.begin() + begin, values.begin() + end, compare);
+  }, kBlockSize);
+
+  std::vector<T> buffer(size);
+  std::vector<T>* from = &values;
+  std::vector<T>* to = &buffer;
+  for (size_t run = kBlockSize; run < size; run *= 2) {
+    // слияние [begin, middle) и [middle, end) режется на куски примерно по kBlockSize:
+    // каждый кусок – пара отрезков из левой и правой половин и место в выходе
+    struct Piece {
+      size_t left_begin, left_end, right_begin, right_end, out;
+    };
+    std::vector<Piece> pieces;
+    for (size_t begin = 0; begin < size; begin += 2 * run) {
+      const size_t middle = std::min(size, begin + run);
+      const size_t end = std::min(size, begin + 2 * run);
+      const auto first = from->begin();
+      size_t left = begin;
+      size_t right = middle;
+      const size_t part_count = std::max<size_t>(1, (end - begin) / kBlockSize);
+      const bool split_left = middle - begin >= end - middle;
+      for (size_t part = 1; part <= part_count; ++part) {
+        size_t left_end = middle;
+        size_t right_end = end;
+        if (part < part_count && split_left) {
+          // равные элементы левой половины идут раньше правой
+          left_end = std::max(left, begin + (middle - begin) * part / part_count);
+          right_end = std::lower_bound(first + right, first + end, (*from)[left_end], compare) - first;
+        } else if (part < part_count) {
+          right_end = std::max(right, middle + (end - middle) * part / part_count);
+          left_end = std::upper_bound(first + left, first + middle, (*from)[right_end], compare) - first;
+        }
+        pieces.push_back({left, left_end, right, right_end, left + right - middle});
+        left = left_end;
+        right = right_end;
+      }
+    }
+
+    pool.ParallelFor(size_t{0}, pieces.size(), [&](size_t index) {
+      const Piece& piece = pieces[index];
+      const auto first = from->begin();
+      std::merge(first + piece.left_begin, first + piece.left_end,
+                 first + piece.right_begin, first + piece.right_end,
+                 to->begin() + piece.out, compare);
+    });
+    std::swap(from, to);
+  }
+
+  if (from != &values) {
+    values.swap(buffer);
+  }
+}
+
+// целые – поразрядной сортировкой, остальное – слиянием
+template <typename T>
+void ParallelSort(std::vector<T>& values, ThreadPool& pool = ThreadPool::Shared()) {
+  if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool>) {
+    ParallelRadixSort(values, pool);
+  } else {
+    ParallelMergeSort(values, std::less<>{}, pool);
+  }
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "char_scan.h"
+#include "thread_pool.h"
+
+#if defined(_MSC_VER) && !defined(__clang__)
+  #define SORTED_LOOKUP_PREFETCH(address) _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0)
+#else
+  #define SORTED_LOOKUP_PREFETCH(address) __builtin_prefetch(address)
+#endif
+
+// Пакетный lower_bound: много ключей против одного отсортированного массива.
+// Поиски идут группами по kGroupSize ключей в ногу: все они сужают диапазон одинаковой
+// длины, шаг делается без ветвлений, а следующая проба заранее запрашивается
+// prefetch-ем, так что промахи кэша разных ключей перекрываются. Последние
+// не больше kLeafSize элементов досчитываются одним SIMD-сравнением.
+// EytzingerArray – та же задача в раскладке Эйтцингера (дерево поиска в порядке BFS):
+// потомки соседних узлов лежат рядом, и prefetch на 4 уровня вперёд – одна кэш-линия.
+
+namespace sorted_lookup_impl {
+
+constexpr size_t kGroupSize = 16;
+constexpr size_t kLeafSize = 16;
+
+inline int PopCount(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  return static_cast<int>(__popcnt(mask));
+#else
+  return __builtin_popcount(mask);
+#endif
+}
+
+// сколько из count элементов начиная с data меньше key
+inline size_t CountLessScalar(const int* data, size_t count, int key) {
+  size_t less = 0;
+  for (size_t i = 0; i < count; ++i) {
+    less += data[i] < key;
+  }
+  return less;
+}
+
+#if defined(CHAR_SCAN_X86)
+
+CHAR_SCAN_TARGET("sse2")
+inline size_t CountLessSse2(const int* data, int key) {
+  const __m128i pattern = _mm_set1_epi32(key);
+  int count = 0;
+  for (size_t i = 0; i < kLeafSize; i += 4) {
+    const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    count += PopCount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(block, pattern))));
+  }
+  return count;
+}
+
+CHAR_SCAN_TARGET("avx2")
+inline size_t CountLessAvx2(const int* data, int key) {
+  const __m256i pattern = _mm256_set1_epi32(key);
+  int count = 0;
+  for (size_t i = 0; i < kLeafSize; i += 8) {
+    const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    count += PopCount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(pattern, block))));
+  }
+  return count;
+}
+
+#endif
+
+// сколько элементов окна из kLeafSize начиная с data (но не дальше end) меньше key
+inline size_t CountLess(const int* data, const int* end, int key, SimdLevel level) {
+#if defined(CHAR_SCAN_X86)
+  if (end - data >= static_cast<std::ptrdiff_t>(kLeafSize)) {
+    switch (level) {
+    case SimdLevel::kAvx2:
+      return CountLessAvx2(data, key);
+    case SimdLevel::kSse2:
+      return CountLessSse2(data, key);
+    case SimdLevel::kScalar:
+      break;
+    }
+  }
+#endif
+  (void)level;
+  return CountLessScalar(data, std::min<size_t>(kLeafSize, end - data), key);
+}
+
+// Ответы для count <= kGroupSize ключей. Инвариант: ответ лежит в [base, base + length],
+// поэтому все элементы после base + length не меньше ключа и счёт в окне
+// из kLeafSize элементов от base даёт точную позицию.
+inline void LowerBoundGroup(const int* data, size_t size, const int* keys, int* positions,
+                            size_t count, SimdLevel level) {
+  const int* bases[kGroupSize];
+  std::fill(bases, bases + count, data);
+  size_t length = size;
+  while (length > kLeafSize) {
+    const size_t half = length / 2;
+    const size_t next_half = (length - half) / 2;
+    for (size_t i = 0; i < count; ++i) {
+      bases[i] = bases[i][half] < keys[i] ? bases[i] + half : bases[i];
+      SORTED_LOOKUP_PREFETCH(bases[i] + next_half);
+    }
+    length -= half;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    positions[i] = static_cast<int>(bases[i] - data + CountLess(bases[i], data + size, keys[i], level));
+  }
+}
+
+inline void LowerBoundRange(const std::vector<int>& sorted, const int* keys, int* positions,
+                            size_t count, SimdLevel level) {
+  for (size_t i = 0; i < count; i += kGroupSize) {
+    LowerBoundGroup(sorted.data(), sorted.size(), keys + i, positions + i,
+                    std::min(kGroupSize, count - i), level);
+  }
+}
+
+}  // namespace sorted_lookup_impl
+
+// позиции std::lower_bound в sorted для каждого ключа из keys
+inline std::vector<int> LowerBoundBatch(const std::vector<int>& sorted, const std::vector<int>& keys,
+                                        SimdLevel level = GetSimdLevel()) {
+  std::vector<int> positions(keys.size());
+  sorted_lookup_impl::LowerBoundRange(sorted, keys.data(), positions.data(), keys.size(), level);
+  return positions;
+}
+
+// то же, ключи делятся между потоками пула
+inline std::vector<int> LowerBoundBatchPar(const std::vector<int>& sorted, const std::vector<int>& keys,
+                                           SimdLevel level = GetSimdLevel()) {
+  std::vector<int> positions(keys.size());
+  ThreadPool::Shared().ParallelForChunks(size_t{0}, keys.size(), [&](size_t begin, size_t end) {
+    sorted_lookup_impl::LowerBoundRange(sorted, keys.data() + begin, positions.data() + begin,
+                                        end - begin, level);
+  });
+  return positions;
+}
+
+// Копия отсортированного массива в раскладке Эйтцингера: корень в ячейке 1,
+// потомки ячейки k – в 2k и 2k + 1. Рядом с каждым значением хранится его позиция
+// в исходном массиве.
+class EytzingerArray {
+public:
+  explicit EytzingerArray(const std::vector<int>& sorted)
+    : values_(sorted.size() + 1)
+    , positions_(sorted.size() + 1)
+    , size_(static_cast<int>(sorted.size()))
+  {
+    Build(sorted, 0, 1);
+    while ((size_t{2} << full_depth_) <= values_.size()) {
+      ++full_depth_;
+    }
+  }
+
+  int LowerBound(int key) const {
+    size_t k = 1;
+    while (k < values_.size()) {
+      // 16 правнуков на 4 уровня ниже занимают 64 байта подряд
+      SORTED_LOOKUP_PREFETCH(values_.data() + std::min(k * 16, values_.size() - 1));
+      k = 2 * k + (values_[k] < key);
+    }
+    // поднимаемся до последнего узла, где ушли налево: это и есть ответ
+    k >>= CountTrailingOnes(k) + 1;
+    return k == 0 ? size_ : positions_[k];
+  }
+
+  std::vector<int> LowerBoundBatch(const std::vector<int>& keys) const {
+    std::vector<int> positions(keys.size());
+    LowerBoundRange(keys.data(), positions.data(), keys.size());
+    return positions;
+  }
+
+  std::vector<int> LowerBoundBatchPar(const std::vector<int>& keys) const {
+    std::vector<int> positions(keys.size());
+    ThreadPool::Shared().ParallelForChunks(size_t{0}, keys.size(), [&](size_t begin, size_t end) {
+      LowerBoundRange(keys.data() + begin, positions.data() + begin, end - begin);
+    });
+    return positions;
+  }
+
+private:
+  // Группа ключей спускается в ногу: первые full_depth_ уровней есть у всех путей,
+  // поэтому внутренний цикл по ключам без проверок, а на последний неполный уровень
+  // спускаются только те, кому он нужен.
+  void LowerBoundGroup(const int* keys, int* positions, size_t count) const {
+    size_t ks[sorted_lookup_impl::kGroupSize];
+    std::fill(ks, ks + count, 1);
+    for (int depth = 0; depth < full_depth_; ++depth) {
+      for (size_t i = 0; i < count; ++i) {
+        SORTED_LOOKUP_PREFETCH(values_.data() + std::min(ks[i] * 16, values_.size() - 1));
+        ks[i] = 2 * ks[i] + (values_[ks[i]] < keys[i]);
+      }
+    }
+    for (size_t i = 0; i < count; ++i) {
+      size_t k = ks[i];
+      if (k < values_.size()) {
+        k = 2 * k + (values_[k] < keys[i]);
+      }
+      k >>= CountTrailingOnes(k) + 1;
+      positions[i] = k == 0 ? size_ : positions_[k];
+    }
+  }
+
+  void LowerBoundRange(const int* keys, int* positions, size_t count) const {
+    for (size_t i = 0; i < count; i += sorted_lookup_impl::kGroupSize) {
+      LowerBoundGroup(keys + i, positions + i, std::min(sorted_lookup_impl::kGroupSize, count - i));
+    }
+  }
+
+  static int CountTrailingOnes(size_t k) {
+    int count = 0;
+    while (k & 1) {
+      k >>= 1;
+      ++count;
+    }
+    return count;
+  }
+
+  // заполняет поддерево с корнем k элементами sorted начиная с next, возвращает следующий
+  size_t Build(const std::vector<int>& sorted, size_t next, size_t k) {
+    if (k < values_.size()) {
+      next = Build(sorted, next, 2 * k);
+      values_[k] = sorted[next];
+      positions_[k] = static_cast<int>(next);
+      next = Build(sorted, next + 1, 2 * k + 1);
+    }
+    return next;
+  }
+
+  std::vector<int> values_;
+  std::vector<int> positions_;
+  int size_;
+  int full_depth_ = 0;  // уровней, полностью лежащих в values_
+};
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Постоянный пул потоков с перехватом задач (work stealing).
+// У каждого потока своя дека: владелец берёт задачи с конца (LIFO),
+// остальные потоки воруют с начала (FIFO).
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t thread_count = DefaultThreadCount())
+    : workers_(std::max<size_t>(thread_count, 1))
+  {
+    threads_.reserve(workers_.size());
+    for (size_t index = 0; index < workers_.size(); ++index) {
+      threads_.emplace_back([this, index] { WorkerLoop(index); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard guard(wake_mutex_);
+      stop_ = true;
+    }
+    wake_cv_.notify_all();
+    for (std::thread& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  // общий пул на всю программу, создаётся при первом обращении
+  static ThreadPool& Shared() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  static size_t DefaultThreadCount() {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  size_t GetThreadCount() const {
+    return threads_.size();
+  }
+
+  // системный дескриптор потока пула – например, чтобы закрепить его за процессорами
+  std::thread::native_handle_type GetNativeHandle(size_t index) {
+    return threads_[index].native_handle();
+  }
+
+  // номер потока пула, из которого сделан вызов, или GetThreadCount() вне потоков пула
+  size_t GetCurrentIndex() const {
+    return current_pool_ == this ? current_index_ : GetThreadCount();
+  }
+
+  template <typename F>
+  auto Submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+    using Result = std::invoke_result_t<std::decay_t<F>>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+    std::future<Result> future = task->get_future();
+    Push([task] { (*task)(); });
+    return future;
+  }
+
+  // ждёт готовности future, а пока ждёт – выполняет чужие задачи,
+  // чтобы ожидание внутри задачи пула не приводило к дедлоку
+  template <typename T>
+  T Wait(std::future<T>& future) {
+    while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      if (!TryRunPendingTask()) {
+        std::this_thread::yield();
+      }
+    }
+    return future.get();
+  }
+
+  // вызывает f(i) для всех i из [begin, end), раздавая индексы кусками по chunk_size;
+  // chunk_size == 0 – примерно по 4 куска на поток
+  template <typename Index, typename F>
+  void ParallelFor(Index begin, Index end, F f, Index chunk_size = 0) {
+    ParallelForChunks(begin, end, [&f](Index chunk_begin, Index chunk_end) {
+      for (Index i = chunk_begin; i < chunk_end; ++i) {
+        f(i);
+      }
+    }, chunk_size);
+  }
+
+  // то же, но f получает сразу весь кусок [chunk_begin, chunk_end)
+  template <typename Index, typename F>
+  void ParallelForChunks(Index begin, Index end, F f, Index chunk_size = 0) {
+    if (begin >= end) {
+      return;
+    }
+    const size_t count = static_cast<size_t>(end - begin);
+    if (chunk_size <= 0) {
+      chunk_size = static_cast<Index>(std::max<size_t>(1, count / (GetThreadCount() * 4)));
+    }
+    const size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+
+    std::atomic<size_t> next_chunk = 0;
+    auto run_chunks = [&] {
+      for (size_t chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++) {
+        const Index chunk_begin = begin + static_cast<Index>(chunk * chunk_size);
+        const Index chunk_end = chunk + 1 == chunk_count
+          ? end
+          : static_cast<Index>(chunk_begin + chunk_size);
+        f(chunk_begin, chunk_end);
+      }
+    };
+
+    // вызывающий поток тоже разбирает куски, поэтому помощников на одного меньше
+    const size_t helper_count = std::min(chunk_count, GetThreadCount() + 1) - 1;
+    std::vector<std::future<void>> helpers;
+    helpers.reserve(helper_count);
+    for (size_t i = 0; i < helper_count; ++i) {
+      helpers.push_back(Submit(run_chunks));
+    }
+    // исключение пробрасываем только после того, как все помощники закончили:
+    // они ссылаются на локальные переменные этой функции
+    std::exception_ptr error;
+    try {
+      run_chunks();
+    } catch (...) {
+      error = std::current_exception();
+      next_chunk = chunk_count;
+    }
+    for (auto& helper : helpers) {
+      try {
+        Wait(helper);
+      } catch (...) {
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+private:
+  using Task = std::function<void()>;
+
+  struct alignas(64) Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void Push(Task task) {
+    Worker& worker = current_pool_ == this
+      ? workers_[current_index_]
+      : workers_[next_worker_++ % workers_.size()];
+    // счётчик растёт раньше, чем задача видна в деке: иначе вор успеет взять её
+    // и уменьшить pending_ ниже нуля
+    {
+      std::lock_guard guard(wake_mutex_);
+      ++pending_;
+    }
+    {
+      std::lock_guard guard(worker.mutex);
+      worker.tasks.push_back(std::move(task));
+    }
+    wake_cv_.notify_one();
+  }
+
+  bool TryPop(size_t index, Task& task) {
+    Worker& worker = workers_[index];
+    std::lock_guard guard(worker.mutex);
+    if (worker.tasks.empty()) {
+      return false;
+    }
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+  }
+
+  bool TrySteal(size_t index, Task& task) {
+    Worker& worker = workers_[index];
+    std::unique_lock lock(worker.mutex, std::try_to_lock);
+    if (!lock || worker.tasks.empty()) {
+      return false;
+    }
+    task = std::move(worker.tasks.front());
+    worker.tasks.pop_front();
+    return true;
+  }
+
+  // сначала своя дека, затем обходим чужие, начиная с соседа
+  bool TryTake(Task& task) {
+    const bool is_worker = current_pool_ == this;
+    const size_t self = is_worker ? current_index_ : next_worker_.load() % workers_.size();
+    if (is_worker && TryPop(self, task)) {
+      return true;
+    }
+    for (size_t shift = is_worker ? 1 : 0; shift < workers_.size(); ++shift) {
+      if (TrySteal((self + shift) % workers_.size(), task)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool TryRunPendingTask() {
+    Task task;
+    if (!TryTake(task)) {
+      return false;
+    }
+    --pending_;
+    task();
+    return true;
+  }
+
+  void WorkerLoop(size_t index) {
+    current_pool_ = this;
+    current_index_ = index;
+    while (true) {
+      if (TryRunPendingTask()) {
+        continue;
+      }
+      std::unique_lock lock(wake_mutex_);
+      wake_cv_.wait(lock, [this] { return stop_ || pending_ > 0; });
+      if (stop_ && pending_ == 0) {
+        break;
+      }
+    }
+  }
+
+  std::vector<Worker> workers_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> next_worker_ = 0;
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cv_;
+  std::atomic<size_t> pending_ = 0;
+  bool stop_ = false;
+
+  inline static thread_local ThreadPool* current_pool_ = nullptr;
+  inline static thread_local size_t current_index_ = 0;
+};
@@ -1,17 +1,38 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <execution>
 #include <functional>
 #include <future>
 #include <iostream>
+#include <memory>
+#include <numeric>
 #include <random>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <vector>
 
+#include "bounded_queue.h"
+#include "char_scan.h"
+#include "counter_rng.h"
+#include "latency_histogram.h"
 #include "profile.h"
+#include "thread_pool.h"
 
 
+// Как потоки делят тесты между собой (аналог schedule в OpenMP):
+// kStatic – заранее, поровну или по кускам chunk_size по кругу;
+// kDynamic – по мере освобождения, кусками по chunk_size;
+// kGuided – по мере освобождения, куски уменьшаются вместе с остатком, но не меньше chunk_size
+enum class ChunkSchedule {
+    kStatic,
+    kDynamic,
+    kGuided,
+};
+
 template <typename FunctionResult, typename... FunctionArgs>
 class Checker {
 public:
@@ -36,21 +57,29 @@ public:
         tests_.clear();
     }
 
+    // режим замера: время каждого теста попадает в гистограмму,
+    // после каждого Run* печатаются перцентили и пропускная способность
+    void EnableLatencyStats() {
+        latency_recorder_ = std::make_unique<LatencyRecorder>();
+    }
+
     // простой запуск с выводом результата
     void RunSeq() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
         for (size_t test_index = 0; test_index < tests_.size(); ++test_index) {
             const Test& test = tests_[test_index];
-            const bool result = test.result_checker(std::apply(function_, test.args));
+            const bool result = RunTest(test);
             std::cerr << "Test " << test_index << (result ? " OK" : " Fail") << std::endl;
         }
     }
 
     // запускаем асинхронно, затем выводим результат
     void RunAsyncPrintAfter() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
         std::vector<std::future<bool>> futures;
         for (const Test& test : tests_) {
-            futures.push_back(std::async([&test, function = function_]{
-                return test.result_checker(std::apply(function, test.args));
+            futures.push_back(std::async([&test, this]{
+                return RunTest(test);
             }));
         }
         for (size_t test_index = 0; test_index < tests_.size(); ++test_index) {
@@ -59,13 +88,31 @@ public:
         }
     }
 
+    // то же, но задачи уходят в общий пул вместо std::async
+    void RunPoolPrintAfter() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
+        ThreadPool& pool = ThreadPool::Shared();
+        std::vector<std::future<bool>> futures;
+        futures.reserve(tests_.size());
+        for (const Test& test : tests_) {
+            futures.push_back(pool.Submit([&test, this]{
+                return RunTest(test);
+            }));
+        }
+        for (size_t test_index = 0; test_index < tests_.size(); ++test_index) {
+            std::cerr << "Test " << test_index <<
+                (pool.Wait(futures[test_index]) ? " OK" : " Fail") << std::endl;
+        }
+    }
+
     // запускаем асинхронно, результат выводим сразу
     void RunAsyncPrintEarly() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
         std::vector<std::future<void>> futures;
         for (size_t test_index = 0; test_index < tests_.size(); ++test_index) {
             const Test& test = tests_[test_index];
-            futures.push_back(std::async([&test, test_index, function = function_]{
-                const bool result = test.result_checker(std::apply(function, test.args));
+            futures.push_back(std::async([&test, test_index, this]{
+                const bool result = RunTest(test);
                 std::cerr << "Test " << test_index << (result ? " OK" : " Fail") << std::endl;
             }));
         }
@@ -76,11 +123,12 @@ public:
 
     // запускаем асинхронно, неправильно подсчитываем количество
     void RunAsyncCountOksNaive() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
         std::vector<std::future<void>> futures;
         size_t ok_count = 0;
         for (const Test& test : tests_) {
-            futures.push_back(std::async([&test, function = function_, &ok_count]{
-                const bool result = test.result_checker(std::apply(function, test.args));
+            futures.push_back(std::async([&test, this, &ok_count]{
+                const bool result = RunTest(test);
                 ok_count += result;  // race condition
             }));
         }
@@ -92,11 +140,12 @@ public:
 
     // запускаем асинхронно, неправильно подсчитываем количество с помощью мьютекса
     void RunAsyncCountOksLocalMutex() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
         std::vector<std::future<void>> futures;
         size_t ok_count = 0;
         for (const Test& test : tests_) {
-            futures.push_back(std::async([&test, function = function_, &ok_count]{
-                const bool result = test.result_checker(std::apply(function, test.args));
+            futures.push_back(std::async([&test, this, &ok_count]{
+                const bool result = RunTest(test);
                 std::mutex m;
                 m.lock();
                 ok_count += result;  // race condition
@@ -112,13 +161,14 @@ public:
     // запускаем асинхронно, подсчитываем количество с помощью мьютекса
     // работает верно, но критическая область слишком большая
     void RunAsyncCountOksWideMutex() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
         std::vector<std::future<void>> futures;
         size_t ok_count = 0;
         std::mutex counter_mutex;
         for (const Test& test : tests_) {
-            futures.push_back(std::async([&test, function = function_, &ok_count, &counter_mutex]{
+            futures.push_back(std::async([&test, this, &ok_count, &counter_mutex]{
                 std::lock_guard guard(counter_mutex);
-                const bool result = test.result_checker(std::apply(function, test.args));
+                const bool result = RunTest(test);
                 ok_count += result;
             }));
         }
@@ -131,12 +181,13 @@ public:
     // запускаем асинхронно, подсчитываем количество с помощью мьютекса
     // работает верно, в критической области только счётчик
     void RunAsyncCountOksRightMutex() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
         std::vector<std::future<void>> futures;
         size_t ok_count = 0;
         std::mutex counter_mutex;
         for (const Test& test : tests_) {
-            futures.push_back(std::async([&test, function = function_, &ok_count, &counter_mutex]{
-                const bool result = test.result_checker(std::apply(function, test.args));
+            futures.push_back(std::async([&test, this, &ok_count, &counter_mutex]{
+                const bool result = RunTest(test);
                 std::lock_guard guard(counter_mutex);
                 ok_count += result;
             }));
@@ -149,11 +200,12 @@ public:
 
     // запускаем асинхронно, подсчитываем количество с помощью атомарного счётчика
     void RunAsyncCountOksAtomic() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
         std::vector<std::future<void>> futures;
         std::atomic_int ok_count = 0;
         for (const Test& test : tests_) {
-            futures.push_back(std::async([&test, function = function_, &ok_count]{
-                const bool result = test.result_checker(std::apply(function, test.args));
+            futures.push_back(std::async([&test, this, &ok_count]{
+                const bool result = RunTest(test);
                 ok_count += result;
             }));
         }
@@ -163,11 +215,31 @@ public:
         std::cerr << ok_count << "/" << tests_.size() << " tests are OK" << std::endl;
     }
 
+    // то же, но по задаче на тест в общем пуле вместо std::async
+    void RunPoolCountOksAtomic() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
+        ThreadPool& pool = ThreadPool::Shared();
+        std::vector<std::future<void>> futures;
+        futures.reserve(tests_.size());
+        std::atomic_int ok_count = 0;
+        for (const Test& test : tests_) {
+            futures.push_back(pool.Submit([&test, this, &ok_count]{
+                const bool result = RunTest(test);
+                ok_count += result;
+            }));
+        }
+        for (auto& future : futures) {
+            pool.Wait(future);
+        }
+        std::cerr << ok_count << "/" << tests_.size() << " tests are OK" << std::endl;
+    }
+
     // циклом подсчитываем количество, оказывается гораздо быстрее
     void RunSeqCountOks() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
         size_t ok_count = 0;
         for (const Test& test : tests_) {
-            const bool result = test.result_checker(std::apply(function_, test.args));
+            const bool result = RunTest(test);
             ok_count += result;
         }
         std::cerr << ok_count << "/" << tests_.size() << " tests are OK" << std::endl;
@@ -175,13 +247,14 @@ public:
 
     // подсчитываем количество с помощью transform_reduce, но подследовательно
     void RunCountOksTRSeq() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
         const size_t ok_count = std::transform_reduce(
             std::execution::seq,
             tests_.begin(), tests_.end(),
             0u,
             std::plus<>{},
-            [function = function_](const Test& test) -> unsigned int {
-                return test.result_checker(std::apply(function, test.args));
+            [this](const Test& test) -> unsigned int {
+                return RunTest(test);
             }
         );
         std::cerr << ok_count << "/" << tests_.size() <<
@@ -190,32 +263,34 @@ public:
 
     // подсчитываем количество с помощью transform_reduce, параллельно
     void RunCountOksTRPar() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
         const size_t ok_count = std::transform_reduce(
             std::execution::par,
             tests_.begin(), tests_.end(),
             0u,
             std::plus<>{},
-            [function = function_](const Test& test) -> unsigned int {
-                return test.result_checker(std::apply(function, test.args));
+            [this](const Test& test) -> unsigned int {
+                return RunTest(test);
             }
         );
         std::cerr << ok_count << "/" << tests_.size() << " tests are OK" << std::endl;
     }
 
     void RunAsyncCountOksAtomicThreadPool() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
         std::vector<std::thread> thread_pool;
         std::atomic_int cur_test = -1;
         std::atomic_int ok_count = 0;
         for (size_t i = 0; i < std::thread::hardware_concurrency(); ++i) {
             thread_pool.emplace_back(
-                [&cur_test, &ok_count, tests = &tests_, function = function_](){
+                [&cur_test, &ok_count, tests = &tests_, this](){
                     while (true) {
                         size_t next_test = ++cur_test;
                         if (next_test >= tests->size()) {
                             break;
                         }
                         const Test& test = (*tests)[next_test];
-                        ok_count += test.result_checker(std::apply(function, test.args));
+                        ok_count += RunTest(test);
                     }
                 }
             );
@@ -227,11 +302,317 @@ public:
             " tests are OK, #threads = " << thread_pool.size() << std::endl;
     }
 
+    // общий пул: потоки не создаются на каждый запуск, тесты раздаются кусками,
+    // атомарный счётчик трогаем один раз на кусок
+    void RunPoolCountOksParallelFor() const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
+        ThreadPool& pool = ThreadPool::Shared();
+        std::atomic_int ok_count = 0;
+        pool.ParallelForChunks(
+            size_t{0}, tests_.size(),
+            [&ok_count, tests = &tests_, this](size_t begin, size_t end) {
+                int local_ok_count = 0;
+                for (size_t test_index = begin; test_index < end; ++test_index) {
+                    const Test& test = (*tests)[test_index];
+                    local_ok_count += RunTest(test);
+                }
+                ok_count += local_ok_count;
+            }
+        );
+        std::cerr << ok_count << "/" << tests_.size() <<
+            " tests are OK, #threads = " << pool.GetThreadCount() << std::endl;
+    }
+
+    // как RunAsyncCountOksAtomicThreadPool, но тесты раздаются кусками по выбранной стратегии,
+    // у каждого потока свой счётчик в отдельной кэш-линии, общий счётчик трогаем раз на кусок
+    void RunThreadPoolCountOksScheduled(ChunkSchedule schedule, size_t chunk_size) const {
+        const LatencyReport latency_report(latency_recorder_.get(), __func__);
+        struct alignas(64) ThreadStats {
+            size_t ok_count = 0;
+            size_t chunk_count = 0;
+        };
+
+        const size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+        const size_t test_count = tests_.size();
+        chunk_size = std::max<size_t>(chunk_size, 1);
+        std::vector<ThreadStats> thread_stats(thread_count);
+        std::atomic<size_t> next_test = 0;
+
+        // следующий кусок [begin, end) для потока; false, когда тесты закончились
+        auto next_chunk = [&](size_t thread_index, size_t& begin, size_t& end) {
+            const size_t chunk_index = thread_stats[thread_index].chunk_count;
+            switch (schedule) {
+            case ChunkSchedule::kStatic:
+                begin = (chunk_index * thread_count + thread_index) * chunk_size;
+                end = std::min(begin + chunk_size, test_count);
+                return begin < test_count;
+            case ChunkSchedule::kDynamic:
+                begin = next_test.fetch_add(chunk_size, std::memory_order_relaxed);
+                end = std::min(begin + chunk_size, test_count);
+                return begin < test_count;
+            case ChunkSchedule::kGuided:
+                begin = next_test.load(std::memory_order_relaxed);
+                do {
+                    if (begin >= test_count) {
+                        return false;
+                    }
+                    const size_t size = std::max(chunk_size, (test_count - begin) / (2 * thread_count));
+                    end = std::min(begin + size, test_count);
+                } while (!next_test.compare_exchange_weak(begin, end, std::memory_order_relaxed));
+                return true;
+            }
+            return false;
+        };
+
+        std::vector<std::thread> thread_pool;
+        for (size_t thread_index = 0; thread_index < thread_count; ++thread_index) {
+            thread_pool.emplace_back([this, thread_index, &thread_stats, &next_chunk] {
+                ThreadStats& stats = thread_stats[thread_index];
+                size_t begin = 0;
+                size_t end = 0;
+                while (next_chunk(thread_index, begin, end)) {
+                    size_t ok_count = 0;
+                    for (size_t test_index = begin; test_index < end; ++test_index) {
+                        ok_count += RunTest(tests_[test_index]);
+                    }
+                    stats.ok_count += ok_count;
+                    ++stats.chunk_count;
+                }
+            });
+        }
+        for (std::thread& t : thread_pool) {
+            t.join();
+        }
+
+        size_t ok_count = 0;
+        for (const ThreadStats& stats : thread_stats) {
+            ok_count += stats.ok_count;
+        }
+        std::cerr << ok_count << "/" << test_count << " tests are OK, #threads = " << thread_count
+            << ", #chunks per thread:";
+        for (const ThreadStats& stats : thread_stats) {
+            std::cerr << " " << stats.chunk_count;
+        }
+        std::cerr << std::endl;
+    }
+
+    // статическое разбиение на thread_count равных кусков
+    void RunThreadPoolCountOksStatic() const {
+        const size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+        RunThreadPoolCountOksScheduled(
+            ChunkSchedule::kStatic, (tests_.size() + thread_count - 1) / thread_count);
+    }
+
 private:
+    bool RunTest(const Test& test) const {
+        if (!latency_recorder_) {
+            return test.result_checker(std::apply(function_, test.args));
+        }
+        const auto start = std::chrono::steady_clock::now();
+        const bool result = test.result_checker(std::apply(function_, test.args));
+        latency_recorder_->Record(std::chrono::steady_clock::now() - start);
+        return result;
+    }
+
     Function function_;
     std::vector<Test> tests_;
+    std::unique_ptr<LatencyRecorder> latency_recorder_;
+};
+
+// Тесты для функций от одной строки, хранящиеся по столбцам: проверяющие функторы
+// в одном векторе, строки всех тестов подряд в одном буфере,
+// тест i – это texts_[text_offsets_[i], text_offsets_[i + 1])
+template <typename ResultChecker>
+class TestBatch {
+public:
+    TestBatch() : text_offsets_{0} {}
+
+    void AddTest(ResultChecker result_checker, std::string_view text) {
+        result_checkers_.push_back(std::move(result_checker));
+        texts_.append(text);
+        text_offsets_.push_back(texts_.size());
+    }
+
+    void Clear() {
+        result_checkers_.clear();
+        texts_.clear();
+        text_offsets_.assign(1, 0);
+    }
+
+    size_t GetTestCount() const {
+        return result_checkers_.size();
+    }
+
+    // прогоняет тесты [begin, end) и возвращает количество успешных
+    template <typename Function>
+    size_t CountOks(Function function, size_t begin, size_t end) const {
+        size_t ok_count = 0;
+        for (size_t test_index = begin; test_index < end; ++test_index) {
+            const std::string_view text(
+                texts_.data() + text_offsets_[test_index],
+                text_offsets_[test_index + 1] - text_offsets_[test_index]);
+            ok_count += result_checkers_[test_index](function(text));
+        }
+        return ok_count;
+    }
+
+private:
+    std::vector<ResultChecker> result_checkers_;
+    std::string texts_;
+    std::vector<size_t> text_offsets_;
+};
+
+// Пакетный вариант Checker для функций от одной строки. Проверяющий функтор – параметр
+// шаблона, а не std::function, поэтому его вызов встраивается; тесты хранятся в TestBatch
+// и прогоняются пакетами по kBatchSize подряд идущих.
+template <typename Function, typename ResultChecker>
+class BatchChecker {
+public:
+    static constexpr size_t kBatchSize = 4096;
+
+    explicit BatchChecker(Function function) : function_(function) {}
+
+    void AddTest(ResultChecker result_checker, std::string_view text) {
+        tests_.AddTest(std::move(result_checker), text);
+    }
+
+    void ClearTests() {
+        tests_.Clear();
+    }
+
+    size_t GetTestCount() const {
+        return tests_.GetTestCount();
+    }
+
+    void RunSeqCountOks() const {
+        size_t ok_count = 0;
+        for (size_t batch = 0; batch < GetBatchCount(); ++batch) {
+            ok_count += RunBatch(batch);
+        }
+        std::cerr << ok_count << "/" << GetTestCount() << " tests are OK" << std::endl;
+    }
+
+    void RunCountOksTRPar() const {
+        std::vector<size_t> batches(GetBatchCount());
+        std::iota(batches.begin(), batches.end(), 0);
+        const size_t ok_count = std::transform_reduce(
+            std::execution::par,
+            batches.begin(), batches.end(),
+            size_t{0},
+            std::plus<>{},
+            [this](size_t batch) {
+                return RunBatch(batch);
+            }
+        );
+        std::cerr << ok_count << "/" << GetTestCount() << " tests are OK" << std::endl;
+    }
+
+private:
+    size_t GetBatchCount() const {
+        return (GetTestCount() + kBatchSize - 1) / kBatchSize;
+    }
+
+    size_t RunBatch(size_t batch) const {
+        const size_t begin = batch * kBatchSize;
+        return tests_.CountOks(function_, begin, std::min(begin + kBatchSize, GetTestCount()));
+    }
+
+    Function function_;
+    TestBatch<ResultChecker> tests_;
+};
+
+template <typename ResultChecker, typename Function>
+BatchChecker<Function, ResultChecker> MakeBatchChecker(Function function) {
+    return BatchChecker<Function, ResultChecker>(function);
+}
+
+
+// Потоковый прогон: тесты не хранятся целиком, а генерируются пакетами на лету.
+// Генераторы заполняют пакеты и кладут их в ограниченную lock-free очередь,
+// рабочие потоки прогоняют пакеты и отправляют количество успешных тестов редуктору
+// (вызывающему потоку). Пустые пакеты возвращаются генераторам через отдельную очередь,
+// поэтому в памяти одновременно живёт не больше GetMaxBatchesInFlight() пакетов.
+template <typename Function, typename ResultChecker>
+class PipelineChecker {
+public:
+    using Batch = TestBatch<ResultChecker>;
+
+    PipelineChecker(Function function,
+                    size_t generator_count = std::max(1u, std::thread::hardware_concurrency() / 2),
+                    size_t worker_count = std::max(1u, std::thread::hardware_concurrency()),
+                    size_t queue_capacity = 64)
+        : function_(function),
+          generator_count_(generator_count),
+          worker_count_(worker_count),
+          queue_capacity_(queue_capacity) {}
+
+    size_t GetMaxBatchesInFlight() const {
+        return queue_capacity_ + generator_count_ + worker_count_;
+    }
+
+    // fill_batch(batch_index, batch) добавляет в пустой пакет тесты с номером пакета batch_index;
+    // вызывается из потоков-генераторов для каждого batch_index из [0, batch_count)
+    template <typename FillBatch>
+    void RunCountOks(size_t batch_count, FillBatch fill_batch) const {
+        std::vector<Batch> batches(GetMaxBatchesInFlight());
+        BoundedQueue<Batch*> free_batches(batches.size());
+        BoundedQueue<Batch*> full_batches(queue_capacity_);
+        BoundedQueue<std::pair<size_t, size_t>> results(queue_capacity_);
+        for (Batch& batch : batches) {
+            free_batches.Push(&batch);
+        }
+
+        std::atomic<size_t> next_batch_to_fill = 0;
+        std::atomic<size_t> next_batch_to_run = 0;
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < generator_count_; ++i) {
+            threads.emplace_back([&] {
+                for (size_t batch_index = next_batch_to_fill++; batch_index < batch_count;
+                     batch_index = next_batch_to_fill++) {
+                    Batch* batch = free_batches.Pop();
+                    batch->Clear();
+                    fill_batch(batch_index, *batch);
+                    full_batches.Push(batch);
+                }
+            });
+        }
+        for (size_t i = 0; i < worker_count_; ++i) {
+            threads.emplace_back([&] {
+                while (next_batch_to_run++ < batch_count) {
+                    Batch* batch = full_batches.Pop();
+                    const size_t test_count = batch->GetTestCount();
+                    const size_t ok_count = batch->CountOks(function_, 0, test_count);
+                    free_batches.Push(batch);
+                    results.Push(std::pair{ok_count, test_count});
+                }
+            });
+        }
+
+        size_t ok_count = 0;
+        size_t test_count = 0;
+        for (size_t i = 0; i < batch_count; ++i) {
+            const auto [batch_ok_count, batch_test_count] = results.Pop();
+            ok_count += batch_ok_count;
+            test_count += batch_test_count;
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        std::cerr << ok_count << "/" << test_count << " tests are OK, #generators = "
+            << generator_count_ << ", #workers = " << worker_count_ << std::endl;
+    }
+
+private:
+    Function function_;
+    size_t generator_count_;
+    size_t worker_count_;
+    size_t queue_capacity_;
 };
 
+template <typename ResultChecker, typename Function>
+PipelineChecker<Function, ResultChecker> MakePipelineChecker(Function function) {
+    return PipelineChecker<Function, ResultChecker>(function);
+}
 
 std::vector<std::string> SplitIntoWords(std::string_view text) {
     std::vector<std::string> words = {""};
@@ -245,6 +626,110 @@ std::vector<std::string> SplitIntoWords(std::string_view text) {
     return words;
 }
 
+// то же, но слова – это view на исходный текст, строки не копируются
+std::vector<std::string_view> SplitIntoWordsView(std::string_view text) {
+    std::vector<std::string_view> words;
+    while (true) {
+        const size_t space = text.find(' ');
+        words.push_back(text.substr(0, space));
+        if (space == std::string_view::npos) {
+            break;
+        }
+        text.remove_prefix(space + 1);
+    }
+    return words;
+}
+
+// то же, но пробелы ищутся по 16 или 32 байта за раз (см. char_scan.h);
+// level позволяет явно выбрать набор инструкций, чтобы сверить все варианты
+std::vector<std::string_view> SplitIntoWordsSimd(std::string_view text, SimdLevel level) {
+    std::vector<std::string_view> words;
+    size_t word_begin = 0;
+    ForEachChar(text, ' ', [text, &words, &word_begin](size_t space) {
+        words.push_back(text.substr(word_begin, space - word_begin));
+        word_begin = space + 1;
+    }, level);
+    words.push_back(text.substr(word_begin));
+    return words;
+}
+
+// Параллельное разбиение одной строки. Текст режется на куски, пробелы в кусках ищутся
+// параллельно. Слово, которое пересекает границу кусков, начинается сразу после последнего
+// пробела в предыдущих кусках; номер первого слова куска – префиксная сумма количеств
+// пробелов в предыдущих кусках. chunk_count == 0 – выбрать число кусков по числу потоков.
+std::vector<std::string_view> SplitIntoWordsPar(std::string_view text, size_t chunk_count) {
+    constexpr size_t kMinChunkSize = 1 << 16;
+
+    ThreadPool& pool = ThreadPool::Shared();
+    if (chunk_count == 0) {
+        chunk_count = std::clamp<size_t>(text.size() / kMinChunkSize, 1, pool.GetThreadCount() * 4);
+    }
+    auto get_chunk_begin = [text, chunk_count](size_t chunk) {
+        return text.size() * chunk / chunk_count;
+    };
+
+    std::vector<std::vector<size_t>> chunk_spaces(chunk_count);
+    pool.ParallelFor(size_t{0}, chunk_count, [&](size_t chunk) {
+        const size_t begin = get_chunk_begin(chunk);
+        const std::string_view chunk_text = text.substr(begin, get_chunk_begin(chunk + 1) - begin);
+        ForEachChar(chunk_text, ' ', [&spaces = chunk_spaces[chunk], begin](size_t space) {
+            spaces.push_back(begin + space);
+        });
+    }, size_t{1});
+
+    // для каждого куска: номер и начало первого слова, которое в нём заканчивается
+    std::vector<size_t> first_words(chunk_count);
+    std::vector<size_t> first_word_begins(chunk_count);
+    size_t word_count = 0;
+    size_t word_begin = 0;
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        first_words[chunk] = word_count;
+        first_word_begins[chunk] = word_begin;
+        if (!chunk_spaces[chunk].empty()) {
+            word_count += chunk_spaces[chunk].size();
+            word_begin = chunk_spaces[chunk].back() + 1;
+        }
+    }
+
+    std::vector<std::string_view> words(word_count + 1);
+    words.back() = text.substr(word_begin);
+    pool.ParallelFor(size_t{0}, chunk_count, [&](size_t chunk) {
+        size_t word = first_words[chunk];
+        size_t word_begin = first_word_begins[chunk];
+        for (const size_t space : chunk_spaces[chunk]) {
+            words[word++] = text.substr(word_begin, space - word_begin);
+            word_begin = space + 1;
+        }
+    }, size_t{1});
+    return words;
+}
+
+// то же, но в переданный буфер: при повторном использовании буфера память не выделяется
+void SplitIntoWordsInto(std::string_view text, std::vector<std::string_view>& words) {
+    words.clear();
+    while (true) {
+        const size_t space = text.find(' ');
+        words.push_back(text.substr(0, space));
+        if (space == std::string_view::npos) {
+            break;
+        }
+        text.remove_prefix(space + 1);
+    }
+}
+
+// обёртка для Checker: у каждого потока свой переиспользуемый буфер,
+// результат действителен до следующего вызова в этом потоке
+const std::vector<std::string_view>& SplitIntoWordsThreadBuffer(std::string_view text) {
+    thread_local std::vector<std::string_view> words;
+    SplitIntoWordsInto(text, words);
+    return words;
+}
+
+// только количество слов
+size_t CountWords(std::string_view text) {
+    return std::count(text.begin(), text.end(), ' ') + 1;
+}
+
 std::string GenerateQuery(std::mt19937& generator, int max_length, int space_rate) {
     const int length = std::uniform_int_distribution(1, max_length)(generator);
     std::string query(length, ' ');
@@ -267,22 +752,159 @@ std::vector<std::string> GenerateQueries(std::mt19937& generator, int query_coun
     return queries;
 }
 
-template <typename Checker>
-void AddQueriesToCheck(Checker& checker, const std::vector<std::string>& queries) {
+// Запросы, лежащие подряд в одном буфере: запрос i – chars[offsets[i], offsets[i + 1])
+struct QueryCorpus {
+    std::string chars;
+    std::vector<size_t> offsets;
+
+    size_t size() const {
+        return offsets.size() - 1;
+    }
+
+    std::string_view operator[](size_t index) const {
+        return std::string_view(chars).substr(offsets[index], offsets[index + 1] - offsets[index]);
+    }
+};
+
+// Генератор запросов с произвольным доступом: запрос с номером i целиком определяется
+// парой (seed, i), поэтому корпус можно генерировать на всех ядрах, а любой упавший тест –
+// воспроизвести по номеру, не проходя всю последовательность. Распределение то же,
+// что у GenerateQuery: длина от 1 до max_length, пробел с вероятностью 1 / space_rate.
+class QueryGenerator {
+public:
+    QueryGenerator(uint64_t seed, int max_length, int space_rate)
+        : seed_(seed), max_length_(max_length), space_rate_(space_rate) {}
+
+    size_t GetLength(size_t index) const {
+        // у каждого запроса свой отрезок счётчика длиной 2^32: номер 0 – длина, дальше символы
+        return CounterRng(seed_, static_cast<uint64_t>(index) << 32).Uniform(1, max_length_);
+    }
+
+    // записывает в output GetLength(index) символов запроса
+    void Write(size_t index, char* output) const {
+        CounterRng generator(seed_, (static_cast<uint64_t>(index) << 32) + 1);
+        const size_t length = GetLength(index);
+        // одно 64-битное число даёт четыре 16-битных, по одному на символ
+        for (size_t pos = 0; pos < length; pos += 4) {
+            const uint64_t bits = generator();
+            for (size_t i = pos; i < std::min(pos + 4, length); ++i) {
+                const uint32_t rnd = ((bits >> (16 * (i - pos))) & 0xFFFF) * space_rate_ >> 16;
+                output[i] = rnd > 0 ? static_cast<char>('a' + (rnd - 1)) : ' ';
+            }
+        }
+    }
+
+    std::string Generate(size_t index) const {
+        std::string query(GetLength(index), ' ');
+        Write(index, query.data());
+        return query;
+    }
+
+    // запросы [first, first + count) параллельно: сначала длины и их префиксные суммы,
+    // затем символы прямо в общий буфер
+    QueryCorpus GenerateBatch(size_t first, size_t count) const {
+        ThreadPool& pool = ThreadPool::Shared();
+        QueryCorpus corpus;
+        corpus.offsets.resize(count + 1);
+        corpus.offsets[0] = 0;
+        pool.ParallelFor(size_t{0}, count, [this, first, &corpus](size_t i) {
+            corpus.offsets[i + 1] = GetLength(first + i);
+        });
+        std::inclusive_scan(
+            std::execution::par,
+            corpus.offsets.begin() + 1, corpus.offsets.end(),
+            corpus.offsets.begin() + 1
+        );
+        corpus.chars.resize(corpus.offsets.back());
+        pool.ParallelFor(size_t{0}, count, [this, first, &corpus](size_t i) {
+            Write(first + i, corpus.chars.data() + corpus.offsets[i]);
+        });
+        return corpus;
+    }
+
+private:
+    uint64_t seed_;
+    int max_length_;
+    uint32_t space_rate_;
+};
+
+template <typename Word>
+size_t GetWordCount(const std::vector<Word>& words) {
+    return words.size();
+}
+
+size_t GetWordCount(size_t word_count) {
+    return word_count;
+}
+
+// подходит для любого варианта SplitIntoWords: проверяется только количество слов;
+// extra_args передаются функции после запроса
+template <typename Checker, typename... ExtraArgs>
+void AddQueriesToCheck(Checker& checker, const std::vector<std::string>& queries,
+                       const ExtraArgs&... extra_args) {
     for (const std::string& query : queries) {
         const size_t space_count = std::count(query.begin(), query.end(), ' ');
         checker.AddTest(
-            [space_count](const std::vector<std::string>& words) {
-                return words.size() == space_count + 1;
+            [space_count](const auto& words) {
+                return GetWordCount(words) == space_count + 1;
+            },
+            query,
+            extra_args...
+        );
+    }
+}
+
+// проверка количества слов для BatchChecker
+struct WordCountChecker {
+    size_t word_count;
+
+    template <typename Words>
+    bool operator()(const Words& words) const {
+        return GetWordCount(words) == word_count;
+    }
+};
+
+// queries – vector<string> или QueryCorpus
+template <typename BatchChecker, typename Queries>
+void AddQueriesToBatchCheck(BatchChecker& checker, const Queries& queries) {
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const std::string_view query = queries[i];
+        const size_t space_count = std::count(query.begin(), query.end(), ' ');
+        checker.AddTest(WordCountChecker{space_count + 1}, query);
+    }
+}
+
+// сверяем результат с SplitIntoWordsView: слова должны совпадать полностью;
+// extra_args передаются функции после запроса
+template <typename Checker, typename... ExtraArgs>
+void AddCrossChecks(Checker& checker, const std::vector<std::string>& queries,
+                    const ExtraArgs&... extra_args) {
+    for (const std::string& query : queries) {
+        checker.AddTest(
+            [query = std::string_view(query)](const std::vector<std::string_view>& words) {
+                return words == SplitIntoWordsView(query);
             },
-            query
+            query,
+            extra_args...
         );
     }
 }
 
+// SplitIntoWordsSimd сверяем на каждом доступном наборе инструкций
+template <typename Checker>
+void AddSimdCrossChecks(Checker& checker, const std::vector<std::string>& queries) {
+    for (int level = 0; level <= static_cast<int>(GetSimdLevel()); ++level) {
+        AddCrossChecks(checker, queries, static_cast<SimdLevel>(level));
+    }
+}
+
 
-int main() {
+// С флагом --latency основной checker печатает перцентили времени отдельных тестов
+int main(int argc, char* argv[]) {
     Checker checker(SplitIntoWords);
+    if (argc > 1 && argv[1] == std::string_view("--latency")) {
+        checker.EnableLatencyStats();
+    }
     checker.AddTest(
         [](const std::vector<std::string>& words) {
             return words == std::vector<std::string>{"aaa", "aa"};
@@ -293,6 +915,7 @@ int main() {
     std::mt19937 generator;
 
 #define PROFILE(method) { LOG_DURATION(#method); checker.method(); }
+#define PROFILE_CALL(call) { LOG_DURATION(#call); checker.call; }
 
     // прогоняем тесты, выводя результат каждого
     {
@@ -301,10 +924,59 @@ int main() {
         
         PROFILE(RunSeq);
         PROFILE(RunAsyncPrintAfter);
+        PROFILE(RunPoolPrintAfter);
         PROFILE(RunAsyncPrintEarly);
 
         checker.ClearTests();
         std::cerr << std::endl;
+
+        // без копирования слов: скалярный поиск пробелов против SIMD
+        {
+            std::cerr << "SplitIntoWordsView" << std::endl;
+            Checker checker(SplitIntoWordsView);
+            AddQueriesToCheck(checker, long_queries);
+            PROFILE(RunSeqCountOks);
+        }
+        {
+            std::cerr << "SplitIntoWordsSimd" << std::endl;
+            Checker checker(SplitIntoWordsSimd);
+            AddQueriesToCheck(checker, long_queries, GetSimdLevel());
+            PROFILE(RunSeqCountOks);
+        }
+
+        // разбиение на всех наборах инструкций должно совпадать со скалярным,
+        // в том числе на коротких строках и на хвостах короче регистра
+        {
+            std::cerr << "SplitIntoWordsSimd cross-check" << std::endl;
+            Checker checker(SplitIntoWordsSimd);
+            AddSimdCrossChecks(checker, long_queries);
+            const std::vector<std::string> edge_queries = {"", " ", "  ", "a", " a", "a ", std::string(32, ' ')};
+            AddSimdCrossChecks(checker, edge_queries);
+            // свой генератор, чтобы не сдвигать входы общих замеров ниже
+            std::mt19937 cross_check_generator(9);
+            const auto short_queries = GenerateQueries(cross_check_generator, 10'000, 100, 2);
+            AddSimdCrossChecks(checker, short_queries);
+            PROFILE(RunCountOksTRPar);
+        }
+
+        // одна строка разбивается параллельно; результат сверяем с последовательным,
+        // в том числе при мелком разбиении, когда слова пересекают границы кусков
+        {
+            std::cerr << "SplitIntoWordsPar" << std::endl;
+            Checker checker(SplitIntoWordsPar);
+            AddQueriesToCheck(checker, long_queries, size_t{0});
+            PROFILE(RunSeqCountOks);
+            checker.ClearTests();
+
+            AddCrossChecks(checker, long_queries, size_t{0});
+            std::mt19937 cross_check_generator(10);
+            const auto short_queries = GenerateQueries(cross_check_generator, 1'000, 100, 2);
+            for (const size_t chunk_count : {1, 2, 3, 7, 64}) {
+                AddCrossChecks(checker, short_queries, chunk_count);
+            }
+            PROFILE(RunSeqCountOks);
+        }
+        std::cerr << std::endl;
     }
     
     // прогоняем тесты, выводя количество успешных
@@ -316,6 +988,7 @@ int main() {
         PROFILE(RunAsyncCountOksWideMutex);
         PROFILE(RunAsyncCountOksRightMutex);
         PROFILE(RunAsyncCountOksAtomic);
+        PROFILE(RunPoolCountOksAtomic);
         PROFILE(RunSeqCountOks);
         checker.ClearTests();
         std::cerr << std::endl;
@@ -330,5 +1003,112 @@ int main() {
         PROFILE(RunCountOksTRSeq);
         PROFILE(RunCountOksTRPar);
         PROFILE(RunAsyncCountOksAtomicThreadPool);
+        PROFILE(RunPoolCountOksParallelFor);
+        PROFILE(RunThreadPoolCountOksStatic);
+        PROFILE_CALL(RunThreadPoolCountOksScheduled(ChunkSchedule::kStatic, 1024));
+        PROFILE_CALL(RunThreadPoolCountOksScheduled(ChunkSchedule::kDynamic, 1024));
+        PROFILE_CALL(RunThreadPoolCountOksScheduled(ChunkSchedule::kGuided, 256));
+        checker.ClearTests();
+        std::cerr << std::endl;
+
+        // те же тесты без выделения памяти под каждое слово
+        {
+            std::cerr << "SplitIntoWordsView" << std::endl;
+            Checker checker(SplitIntoWordsView);
+            checker.AddTest(
+                [](const std::vector<std::string_view>& words) {
+                    return words == std::vector<std::string_view>{"aaa", "aa"};
+                },
+                "aaa aa"
+            );
+            AddQueriesToCheck(checker, more_short_queries);
+            PROFILE(RunSeqCountOks);
+            PROFILE(RunCountOksTRPar);
+            std::cerr << std::endl;
+        }
+        {
+            std::cerr << "SplitIntoWordsThreadBuffer" << std::endl;
+            Checker checker(SplitIntoWordsThreadBuffer);
+            AddQueriesToCheck(checker, more_short_queries);
+            PROFILE(RunSeqCountOks);
+            PROFILE(RunCountOksTRPar);
+            std::cerr << std::endl;
+        }
+        {
+            std::cerr << "CountWords" << std::endl;
+            Checker checker(CountWords);
+            AddQueriesToCheck(checker, more_short_queries);
+            PROFILE(RunSeqCountOks);
+            PROFILE(RunCountOksTRPar);
+            std::cerr << std::endl;
+        }
+
+        // те же тесты в пакетном Checker: без std::function и без строки на каждый тест
+        {
+            std::cerr << "BatchChecker, SplitIntoWords" << std::endl;
+            auto checker = MakeBatchChecker<WordCountChecker>(SplitIntoWords);
+            AddQueriesToBatchCheck(checker, more_short_queries);
+            PROFILE(RunSeqCountOks);
+            PROFILE(RunCountOksTRPar);
+            std::cerr << std::endl;
+        }
+        {
+            std::cerr << "BatchChecker, CountWords" << std::endl;
+            auto checker = MakeBatchChecker<WordCountChecker>(CountWords);
+            AddQueriesToBatchCheck(checker, more_short_queries);
+            PROFILE(RunSeqCountOks);
+            PROFILE(RunCountOksTRPar);
+        }
+        std::cerr << std::endl;
+    }
+
+    // генерация корпуса: последовательный mt19937 против параллельного генератора
+    // с произвольным доступом, который пишет все запросы в один буфер
+    {
+        constexpr size_t kQueryCount = 10'000'000;
+        {
+            LOG_DURATION("GenerateQueries");
+            GenerateQueries(generator, kQueryCount, 10, 4);
+        }
+        const QueryGenerator query_generator(12345, 10, 4);
+        const QueryCorpus corpus = [&query_generator] {
+            LOG_DURATION("QueryGenerator::GenerateBatch");
+            return query_generator.GenerateBatch(0, kQueryCount);
+        }();
+
+        std::cerr << "BatchChecker, QueryCorpus" << std::endl;
+        auto checker = MakeBatchChecker<WordCountChecker>(SplitIntoWords);
+        AddQueriesToBatchCheck(checker, corpus);
+        PROFILE(RunCountOksTRPar);
+
+        // любой запрос воспроизводится по номеру
+        const size_t sample_index = kQueryCount / 2;
+        std::cerr << "query #" << sample_index << " regenerated "
+            << (query_generator.Generate(sample_index) == corpus[sample_index] ? "OK" : "Fail")
+            << std::endl << std::endl;
+    }
+
+    // столько же тестов, но без хранения: генерируем, прогоняем и проверяем на лету,
+    // память ограничена числом пакетов в конвейере
+    {
+        constexpr size_t kTestCount = 10'000'000;
+        constexpr size_t kBatchSize = 4096;
+        const QueryGenerator query_generator(12345, 10, 4);
+        auto checker = MakePipelineChecker<WordCountChecker>(SplitIntoWords);
+        LOG_DURATION("PipelineChecker::RunCountOks");
+        checker.RunCountOks(
+            (kTestCount + kBatchSize - 1) / kBatchSize,
+            [kTestCount, kBatchSize, &query_generator](size_t batch_index, auto& batch) {
+                std::string query;
+                const size_t begin = batch_index * kBatchSize;
+                const size_t end = std::min(begin + kBatchSize, kTestCount);
+                for (size_t test_index = begin; test_index < end; ++test_index) {
+                    query.resize(query_generator.GetLength(test_index));
+                    query_generator.Write(test_index, query.data());
+                    const size_t space_count = std::count(query.begin(), query.end(), ' ');
+                    batch.AddTest(WordCountChecker{space_count + 1}, query);
+                }
+            }
+        );
     }
 }
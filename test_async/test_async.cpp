@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "profile.h"
+#include "thread_pool.h"
 
 int NUM_TESTS = std::thread::hardware_concurrency();
 
@@ -23,9 +24,21 @@ void Async() {
 	}
 }
 
+void Pool() {
+	ThreadPool& pool = ThreadPool::Shared();
+	std::vector<std::future<void>> futures;
+	for (int i = 0; i < NUM_TESTS; ++i) {
+		futures.push_back(pool.Submit(SlowFunction));
+	}
+	for (auto& future : futures) {
+		pool.Wait(future);
+	}
+}
+
 #define PROFILE(function) { LOG_DURATION(#function); function(); }
 
 int main() {
 	PROFILE(Seq);
 	PROFILE(Async);
+	PROFILE(Pool);
 }
\ No newline at end of file